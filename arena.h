@@ -0,0 +1,129 @@
+#ifndef __ARENA_H_
+#define __ARENA_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdalign.h>
+
+#include "counters.h"
+
+// Bytes in each block, big requests get a block of their own
+#define ARENA_BLOCK_SIZE (64 * 1024)
+// Every allocation starts at a multiple of this
+#define ARENA_ALIGNMENT 16
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  arena.h
+ *
+ * Description: A region allocator for the small things an assembly makes lots of and
+ * only needs until it is done, like the copies of instructions waiting on a label.
+ * Allocating is bumping a pointer in the current block, nothing is freed on its own,
+ * and the whole region goes back in one call when the assembly is freed. A new block
+ * is allocated (and counted, see counters.h) every ARENA_BLOCK_SIZE bytes, instead of
+ * a malloc and a free for every copy.
+ *
+ * An arena is not locked, so only one thread may allocate from it at a time.
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+typedef struct arena_block_type
+{
+	struct arena_block_type *next;
+	size_t used;
+	size_t size;
+	alignas(ARENA_ALIGNMENT) char data[];
+} arena_block_t;
+
+/*
+ * The blocks of an arena, the one being filled first. { NULL } is an empty arena.
+ */
+typedef struct
+{
+	arena_block_t *blocks;
+} arena_t;
+
+static inline void* arena_alloc(arena_t* arena, size_t size);
+
+static inline char* arena_strdup(arena_t* arena, const char* str);
+
+static inline void arena_free(arena_t* arena);
+
+/*
+ * =====================================================================================
+ * Returns size bytes from the arena, or NULL if we ran out of memory. They stay
+ * allocated until arena_free.
+ * =====================================================================================
+ */
+static inline void* arena_alloc(arena_t* arena, size_t size)
+{
+	arena_block_t *block = arena->blocks;
+	void *ptr;
+
+	size = (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+	if (block == NULL || block->size - block->used < size)
+	{
+		size_t block_size = (size > ARENA_BLOCK_SIZE / 4) ? size : ARENA_BLOCK_SIZE;
+
+		block = (arena_block_t*) counted_malloc(sizeof(arena_block_t) + block_size);
+		if (block == NULL)
+			return NULL;
+		block->used = 0;
+		block->size = block_size;
+		if (block_size == size && arena->blocks != NULL)
+		{
+			// A block of its own goes behind the one being filled, which still has room
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		}
+		else
+		{
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+	}
+
+	ptr = block->data + block->used;
+	block->used += size;
+	return ptr;
+}
+
+/*
+ * =====================================================================================
+ * Copies str into the arena. Returns NULL if we ran out of memory.
+ * =====================================================================================
+ */
+static inline char* arena_strdup(arena_t* arena, const char* str)
+{
+	size_t len = strlen(str) + 1;
+	char *copy = (char*) arena_alloc(arena, len);
+
+	if (copy != NULL)
+		memcpy(copy, str, len);
+	return copy;
+}
+
+/*
+ * =====================================================================================
+ * Frees everything allocated from the arena, which is empty again afterwards.
+ * =====================================================================================
+ */
+static inline void arena_free(arena_t* arena)
+{
+	arena_block_t *block, *next;
+
+	for (block = arena->blocks; block != NULL; block = next)
+	{
+		next = block->next;
+		free(block);
+	}
+	arena->blocks = NULL;
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef __ASCIIZ_H_
+#define __ASCIIZ_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define TRUE 1
+#define FALSE 0
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  asciiz.h
+ *
+ * Description: The strings of .asciiz declarations. A string is everything between the
+ * first double quote after .asciiz and the next one that is not escaped, so it can
+ * hold spaces, '#' and \" and be as long as the source line. These escapes are
+ * understood:
+ *
+ *   \n \t \r \0 \\ \" and \xH or \xHH (one byte in hex)
+ *
+ * The first pass only needs the length of a string (asciiz_length) and the second pass
+ * packs it (pack_asciiz). Both decode the escapes with next_asciiz_byte, so the space
+ * the first pass sets aside is always exactly what the second pass fills. A string
+ * takes asciiz_words words: its bytes four to a word, the first one in the low byte,
+ * then the null terminator. Both walk the string once.
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+static inline int32_t find_asciiz(const char* start, const char* end, const char** str, const char** str_end);
+
+static inline const char* next_asciiz_byte(const char* ptr, const char* end, uint8_t* byte);
+
+static inline int32_t hex_digit(char c);
+
+static inline int32_t asciiz_length(const char* str, const char* str_end, int32_t* len);
+
+static inline int32_t asciiz_words(int32_t len);
+
+static inline void pack_asciiz(const char* str, const char* str_end, uint32_t* words);
+
+/*
+ * =====================================================================================
+ * Finds the string of the .asciiz declaration in the line from start to end. str gets
+ * its first character and str_end the closing quote. Returns FALSE if there is no
+ * .asciiz, no opening quote after it or no closing quote.
+ * =====================================================================================
+ */
+static inline int32_t find_asciiz(const char* start, const char* end, const char** str, const char** str_end)
+{
+	size_t directive_len = strlen(".asciiz");
+	const char *ptr = start;
+
+	// The line is not null terminated, so look for the directive by hand
+	while (1)
+	{
+		ptr = (const char*) memchr(ptr, '.', end - ptr);
+		if (ptr == NULL || ptr + directive_len > end)
+			return FALSE;
+		if (memcmp(ptr, ".asciiz", directive_len) == 0)
+			break;
+		ptr++;
+	}
+
+	ptr = (const char*) memchr(ptr + directive_len, '"', end - (ptr + directive_len));
+	if (ptr == NULL)
+		return FALSE;
+
+	*str = ++ptr;
+	while (ptr < end && *ptr != '"')
+	{
+		// Skip whatever is escaped, which might be a quote
+		ptr += (*ptr == '\\' && ptr + 1 < end) ? 2 : 1;
+	}
+	if (ptr >= end)
+		return FALSE;
+	*str_end = ptr;
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Decodes the byte at ptr (which is before end), an escape or a plain character. The
+ * byte goes in byte. Returns the spot after it, or NULL if it is an escape we don't
+ * know.
+ * =====================================================================================
+ */
+static inline const char* next_asciiz_byte(const char* ptr, const char* end, uint8_t* byte)
+{
+	int32_t digit;
+
+	if (*ptr != '\\')
+	{
+		*byte = (uint8_t) *ptr;
+		return ptr + 1;
+	}
+	if (++ptr >= end)
+		return NULL;
+
+	switch (*ptr)
+	{
+		case 'n': *byte = '\n'; break;
+		case 't': *byte = '\t'; break;
+		case 'r': *byte = '\r'; break;
+		case '0': *byte = '\0'; break;
+		case '\\': *byte = '\\'; break;
+		case '"': *byte = '"'; break;
+		case 'x':
+			// One or two hex digits
+			if (ptr + 1 >= end || (digit = hex_digit(ptr[1])) < 0)
+				return NULL;
+			*byte = (uint8_t) digit;
+			ptr++;
+			if (ptr + 1 < end && (digit = hex_digit(ptr[1])) >= 0)
+			{
+				*byte = (uint8_t)((*byte << 4) | digit);
+				ptr++;
+			}
+			break;
+		default:
+			return NULL;
+	}
+	return ptr + 1;
+}
+
+/*
+ * =====================================================================================
+ * Returns the value of a hex digit, or -1 if c is not one.
+ * =====================================================================================
+ */
+static inline int32_t hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/*
+ * =====================================================================================
+ * Works out how many bytes the string from str to str_end is once the escapes are
+ * decoded, without the null terminator, and puts it in len. Returns FALSE if it has
+ * an escape we don't know.
+ * =====================================================================================
+ */
+static inline int32_t asciiz_length(const char* str, const char* str_end, int32_t* len)
+{
+	uint8_t byte;
+	int32_t count = 0;
+
+	while (str < str_end)
+	{
+		str = next_asciiz_byte(str, str_end, &byte);
+		if (str == NULL)
+			return FALSE;
+		count++;
+	}
+	*len = count;
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Returns how many words a string of len bytes takes with its null terminator.
+ * =====================================================================================
+ */
+static inline int32_t asciiz_words(int32_t len)
+{
+	return len / 4 + 1;
+}
+
+/*
+ * =====================================================================================
+ * Packs the string from str to str_end into words, which has room for asciiz_words of
+ * its length, is all zeros and was checked by asciiz_length. The first byte goes in
+ * the low byte of the first word.
+ * =====================================================================================
+ */
+static inline void pack_asciiz(const char* str, const char* str_end, uint32_t* words)
+{
+	uint8_t byte = 0;
+	uint32_t i = 0;
+
+	while (str < str_end)
+	{
+		str = next_asciiz_byte(str, str_end, &byte);
+		words[i >> 2] |= (uint32_t) byte << (8 * (i & 3));
+		i++;
+	}
+}
+
+#endif
@@ -0,0 +1,2053 @@
+#ifndef __ASSEMBLER_H_
+#define __ASSEMBLER_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "tokenizer.h"
+#include "hash_table.h"
+#include "initialization.h"
+#include "source.h"
+#include "utilities.h"
+#include "output.h"
+#include "incremental.h"
+#include "arena.h"
+#include "asciiz.h"
+#include "stats.h"
+#include "trace.h"
+
+// Part of the output cache key, so change it whenever the output for a source could change
+#define ASSEMBLER_VERSION "2.3"
+#define MAX_LINE_LENGTH 256
+#define MAX_ERROR_LENGTH 512
+#define MAX_ENCODE_THREADS 64
+// Fewest text lines worth handing to an encoding thread of their own
+#define MIN_ENCODE_CHUNK 4096
+#define DATA_SEGMENT_START_ADDRESS 8192
+#define TEXT_SEGMENT_START_ADDRESS 0
+#define TRUE 1
+#define FALSE 0
+
+// Instruction formats. Each field is masked to its width and shifted into place.
+#define ENCODE_R_TYPE(rs, rt, rd, shamt, funct) \
+	((((rs) & 0x1f) << 21) | (((rt) & 0x1f) << 16) | (((rd) & 0x1f) << 11) | (((shamt) & 0x1f) << 6) | ((funct) & 0x3f))
+#define ENCODE_I_TYPE(op, rs, rt, imm) \
+	((((op) & 0x3f) << 26) | (((rs) & 0x1f) << 21) | (((rt) & 0x1f) << 16) | ((imm) & 0xffff))
+#define ENCODE_J_TYPE(op, addr) \
+	((((op) & 0x3f) << 26) | ((addr) & 0x3ffffff))
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  assembler.h
+ *
+ * Description: The assembler itself: the zeroth, first and second pass, the single
+ * pass, and the instruction encoders. Everything one assembly needs is kept in an
+ * assembler_t, so several files can be assembled at the same time. The opcode,
+ * register and delimiter tables are shared and only read once they are built.
+ *
+ * Programs that want to assemble without going through files can include this header
+ * and call assemble_buffer, which takes the source as a string and hands back the
+ * encoded words and the symbols. It never touches the filesystem, prints anything or
+ * exits; errors come back as a message in the result. Everything in the headers is
+ * static, so any number of C or C++ files can include it, each with its own copy.
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+/*
+ * A forward reference to a label that has not been defined yet. We keep the
+ * instruction and its operands so that the word can be encoded once the label
+ * shows up.
+ */
+typedef struct fixup_type
+{
+	char *label;
+	char *inst;
+	char *operands[3];
+	int32_t pc;
+	int32_t slot;
+	struct fixup_type *next;
+} fixup_t;
+
+/*
+ * One encoded instruction of the text segment in single pass mode (two words
+ * for la). fixup is set while the instruction is still waiting on a label.
+ */
+typedef struct
+{
+	uint32_t words[2];
+	int32_t num_words;
+	fixup_t *fixup;
+} text_slot_t;
+
+/*
+ * How to assemble. With use_single_pass the source is read once (see
+ * single_pass). Otherwise, threads is how many threads the second pass may
+ * use to encode the text segment; 1 (or 0) encodes it in this thread. If
+ * state_file is set, the encoded text lines are kept in it for the next
+ * assembly, which only encodes the lines that changed (see
+ * encode_text_incremental).
+ */
+typedef struct
+{
+	int32_t use_single_pass;
+	int32_t threads;
+	const char *state_file;
+} assembler_options_t;
+
+/*
+ * A text segment line in the second pass and the address of its instruction.
+ * With a state file, reused is the line from the last assembly with the same
+ * text, or NULL if there was none.
+ */
+typedef struct
+{
+	line_t slice;
+	int32_t pc;
+	line_state_t *reused;
+} text_line_t;
+
+/*
+ * The state of one assembly. The passes take it as their first argument and
+ * return FALSE when something goes wrong, with the message in error.
+ */
+typedef struct
+{
+	assembler_options_t options;
+	symbol_table_t *symbol_table;
+	// Only used by the single pass: labels -> list of instructions waiting on them
+	hash_table_t *fixup_table;
+	// Where the fixups and their lists come from, all freed with the context
+	arena_t arena;
+	text_slot_t *text_image;
+	int32_t text_image_size;
+	int32_t text_image_capacity;
+	int32_t instr_ptr;
+	word_image_t text;
+	word_image_t data;
+	// Only used with a state file: the text lines from the last assembly and from this one
+	line_state_table_t previous_lines;
+	line_state_table_t next_lines;
+	int32_t lines_reused;
+	int32_t lines_encoded;
+	// How long each pass took, for --stats
+	double seconds[NUM_STAGES];
+	char error[MAX_ERROR_LENGTH];
+} assembler_t;
+
+/*
+ * A piece of the text segment encoded by one thread in the second pass. as
+ * is a copy of the context that shares its frozen symbol table but has its
+ * own error and text image. If states is set, each line is encoded into its
+ * own state instead of the image (see encode_text_states). counters is what
+ * the thread counted doing it.
+ */
+typedef struct
+{
+	assembler_t as;
+	text_line_t *lines;
+	int32_t count;
+	line_state_t *states;
+	int32_t ok;
+	run_counters_t counters;
+} encode_chunk_t;
+
+/*
+ * A label in an assembly_result_t. name points into the result and is null
+ * terminated.
+ */
+typedef struct
+{
+	const char *name;
+	int32_t address;
+	int32_t section;
+	int32_t size;
+	int32_t kind;
+} assembly_symbol_t;
+
+/*
+ * What assemble_buffer hands back. text and data hold the encoded words and
+ * their start addresses (read word i with image_word, since a .word array
+ * is kept as a run), symbols holds every label in the order it was defined,
+ * and error says what went wrong if the assembly failed. All of it is freed
+ * with free_assembly_result.
+ */
+typedef struct
+{
+	word_image_t text;
+	word_image_t data;
+	assembly_symbol_t *symbols;
+	int32_t symbol_count;
+	symbol_table_t *symbol_table;
+	char error[MAX_ERROR_LENGTH];
+} assembly_result_t;
+
+static inline int32_t assemble_buffer(const char* buffer, size_t len, assembler_options_t* options, assembly_result_t* result);
+
+static inline void free_assembly_result(assembly_result_t* result);
+
+static inline int32_t init_assembler(assembler_t* as, assembler_options_t* options);
+
+static inline void free_assembler(assembler_t* as);
+
+static inline int32_t assembler_error(assembler_t* as, const char* format, ...);
+
+static inline int32_t assemble_source(assembler_t* as, source_t* src);
+
+static inline int32_t first_pass(assembler_t* as, merged_lines_t *merged);
+
+static inline int32_t second_pass(assembler_t* as, merged_lines_t *merged);
+
+static inline int32_t encode_text(assembler_t* as, text_line_t* lines, int32_t count);
+
+static inline int32_t encode_text_chunks(assembler_t* as, text_line_t* lines, int32_t count, line_state_t* states);
+
+static inline void* encode_worker(void* arg);
+
+static inline int32_t encode_text_lines(assembler_t* as, text_line_t* lines, int32_t count, word_image_t* image);
+
+static inline int32_t encode_text_states(assembler_t* as, text_line_t* lines, int32_t count, line_state_t* states);
+
+static inline int32_t encode_text_incremental(assembler_t* as, text_line_t* lines, int32_t count);
+
+static inline int32_t encode_text_line(assembler_t* as, text_line_t* line, line_state_t* state, char* label);
+
+static inline int32_t single_pass(assembler_t* as, source_t *src);
+
+static inline int32_t define_text_label(assembler_t* as, token_view_t* token, int32_t addr);
+
+static inline int32_t define_data_line(assembler_t* as, char* token, char* line, line_t* slice, int32_t addr, int32_t* bytes);
+
+static inline int32_t parse_word_array(char* line, int32_t* value, int32_t* size);
+
+static inline int32_t insert_symbol(assembler_t* as, char* label, int32_t len, int32_t addr, int32_t kind, int32_t size);
+
+static inline int32_t emit_data_line(assembler_t* as, char* token, char* line, line_t* slice, word_image_t* data);
+
+static inline int32_t emit_word(assembler_t* as, word_image_t* image, uint32_t word);
+
+static inline void parse_operands(char* inst, char** tok_ptr, char* end, char operand_buf[][MAX_LINE_LENGTH + 1], char** operands);
+
+static inline char* next_operand(char** tok_ptr, char* end, delim_set_t* delims, char* buf);
+
+static inline char* instr_label(char* inst, char** operands);
+
+static inline int32_t instr_size(token_view_t* inst);
+
+static inline int32_t encode_instr(assembler_t* as, char* inst, char** operands, int32_t pc, uint32_t* words);
+
+static inline int32_t add_text_slot(assembler_t* as);
+
+static inline int32_t add_fixup(assembler_t* as, char* inst, char** operands, int32_t pc, int32_t slot);
+
+static inline int32_t resolve_fixups(assembler_t* as, char* label, int32_t len);
+
+static inline int32_t process_r_type_instr(assembler_t* as, char* inst, char* rs, char* rt, char* rd, uint32_t* word);
+
+static inline int32_t process_i_type_instr(assembler_t* as, char* inst, char* rs, char* rt, char* imm, int32_t pc, uint32_t* word);
+
+static inline int32_t process_j_type_instr(assembler_t* as, char* inst, char* imm, uint32_t* word);
+
+static inline int32_t process_psuedo_instr(assembler_t* as, char* inst, char* r, char* label, uint32_t* words);
+
+static inline int32_t parse_asciiz(assembler_t* as, const char* str, const char* str_end, int32_t len, word_image_t* data);
+
+static inline void init_delim_sets();
+
+// Delimiter sets for the tokenizer, built once by init_delim_sets the first
+// time an assembler is set up and only read after that
+static delim_set_t section_delims;
+
+static delim_set_t instr_delims;
+
+static delim_set_t line_delims;
+
+static delim_set_t operand_delims;
+
+static delim_set_t last_operand_delims;
+
+static delim_set_t mem_operand_delims;
+
+static delim_set_t last_mem_operand_delims;
+
+static pthread_once_t delim_sets_once = PTHREAD_ONCE_INIT;
+
+/*
+ * ============================================================================
+ * Assembles len bytes of source from buffer, which does not have to be null
+ * terminated and is not changed. Works the same way as the assembler program
+ * (see assemble_source), but the words and symbols end up in result instead
+ * of a file. options can be NULL for a plain two pass assembly. Returns FALSE if there was an error, with the message in
+ * result->error. Either way, result has to be freed with
+ * free_assembly_result.
+ * ============================================================================
+ */
+static inline int32_t assemble_buffer(const char* buffer, size_t len, assembler_options_t* options, assembly_result_t* result)
+{
+	assembler_t as;
+	source_t source;
+	uint32_t i;
+	int32_t ok;
+
+	memset(result, 0, sizeof(assembly_result_t));
+	result->text.address = TEXT_SEGMENT_START_ADDRESS;
+	result->data.address = DATA_SEGMENT_START_ADDRESS;
+
+	if (init_assembler(&as, options) == FALSE)
+	{
+		strcpy(result->error, as.error);
+		free_assembler(&as);
+		return FALSE;
+	}
+
+	// The passes only ever read the source, so the buffer can be used as it is
+	source.data = (char*) buffer;
+	source.len = len;
+	source.mapped = FALSE;
+
+	ok = assemble_source(&as, &source);
+	if (ok == TRUE)
+	{
+		result->symbols = (assembly_symbol_t*) counted_malloc(sizeof(assembly_symbol_t) * (as.symbol_table->count + 1));
+		if (result->symbols == NULL)
+			ok = assembler_error(&as, "ERROR: Unable to allocate memory. Aborting...");
+	}
+	if (ok == FALSE)
+	{
+		strcpy(result->error, as.error);
+		free_assembler(&as);
+		return FALSE;
+	}
+
+	// The names stay in the symbol table, which the result takes over along with the images
+	for (i = 0; i < as.symbol_table->count; i++)
+	{
+		symbol_entry_t *entry = &as.symbol_table->entries[i];
+		result->symbols[i].name = symbol_key(as.symbol_table, entry);
+		result->symbols[i].address = entry->symbol.address;
+		result->symbols[i].section = entry->symbol.section;
+		result->symbols[i].size = entry->symbol.size;
+		result->symbols[i].kind = entry->symbol.kind;
+	}
+	result->symbol_count = as.symbol_table->count;
+	result->symbol_table = as.symbol_table;
+	result->text = as.text;
+	result->data = as.data;
+	as.symbol_table = NULL;
+	memset(&as.text, 0, sizeof(word_image_t));
+	memset(&as.data, 0, sizeof(word_image_t));
+	free_assembler(&as);
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Frees everything assemble_buffer put in result.
+ * ============================================================================
+ */
+static inline void free_assembly_result(assembly_result_t* result)
+{
+	free_word_image(&result->text);
+	free_word_image(&result->data);
+	free(result->symbols);
+	if (result->symbol_table != NULL)
+		destroy_symbol_table(result->symbol_table);
+	result->symbols = NULL;
+	result->symbol_table = NULL;
+	result->symbol_count = 0;
+}
+
+/*
+ * ============================================================================
+ * Builds the lookup tables for all the delimiter sets the passes tokenize
+ * with, so it is done once instead of on every token.
+ * ============================================================================
+ */
+static inline void init_delim_sets()
+{
+	trace_span_t span;
+
+	trace_begin(&span, "init_delim_sets");
+
+	// First token of a line when looking for a section
+	init_delim_set(&section_delims, " ()\n\t\r,#");
+
+	// First token of a line in the .text section
+	init_delim_set(&instr_delims, " ()\n\t,\r");
+
+	// A whole line in the .data section
+	init_delim_set(&line_delims, "\n\r");
+
+	// Registers and immediates, the last one can be followed by a comment
+	init_delim_set(&operand_delims, " ,\t\n\r");
+	init_delim_set(&last_operand_delims, " ,\t\n\r#");
+
+	// Same thing for offset(base) operands and labels
+	init_delim_set(&mem_operand_delims, " ,()\t\n\r");
+	init_delim_set(&last_mem_operand_delims, " ,()\t\n\r#");
+	trace_end(&span, NULL);
+}
+
+/*
+ * ============================================================================
+ * Sets up an empty assembler context with its own symbol table, building the
+ * shared delimiter sets if this is the first one. options can be NULL for the
+ * defaults. Returns FALSE if we ran out of memory.
+ * ============================================================================
+ */
+static inline int32_t init_assembler(assembler_t* as, assembler_options_t* options)
+{
+	trace_span_t span;
+
+	trace_begin(&span, "init_assembler");
+
+	// The tokenizer tables are shared by every assembly, so only the first one builds them
+	pthread_once(&delim_sets_once, init_delim_sets);
+
+	memset(as, 0, sizeof(assembler_t));
+	if (options != NULL)
+		as->options = *options;
+	if (as->options.threads < 1)
+		as->options.threads = 1;
+	if (as->options.threads > MAX_ENCODE_THREADS)
+		as->options.threads = MAX_ENCODE_THREADS;
+	as->text.address = TEXT_SEGMENT_START_ADDRESS;
+	as->data.address = DATA_SEGMENT_START_ADDRESS;
+
+	// Create a hash table that will hold labels and the corresponding address.
+	as->symbol_table = create_symbol_table(1024);
+	trace_end(&span, NULL);
+	if (as->symbol_table == NULL)
+		return assembler_error(as, "ERROR: Could not create a symbol hashtable. Aborting...");
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Frees everything the context holds, including the forward references that
+ * were still waiting on a label if the assembly stopped early.
+ * ============================================================================
+ */
+static inline void free_assembler(assembler_t* as)
+{
+	if (as->symbol_table != NULL)
+		destroy_symbol_table(as->symbol_table);
+	as->symbol_table = NULL;
+
+	free(as->text_image);
+	as->text_image = NULL;
+	as->text_image_size = as->text_image_capacity = 0;
+
+	// The table only owns its keys, the fixups and list heads are in the arena
+	if (as->fixup_table != NULL)
+		destroy_hash_table(as->fixup_table);
+	as->fixup_table = NULL;
+	arena_free(&as->arena);
+
+	free_word_image(&as->text);
+	free_word_image(&as->data);
+	free_line_states(&as->previous_lines);
+	free_line_states(&as->next_lines);
+}
+
+/*
+ * ============================================================================
+ * Records why the assembly failed. Only the first error is kept, since that
+ * is the one that stopped the passes. Always returns FALSE so callers can
+ * return it directly.
+ * ============================================================================
+ */
+static inline int32_t assembler_error(assembler_t* as, const char* format, ...)
+{
+	va_list args;
+
+	if (as->error[0] != '\0')
+		return FALSE;
+
+	va_start(args, format);
+	vsnprintf(as->error, sizeof(as->error), format, args);
+	va_end(args);
+	return FALSE;
+}
+
+/*
+ * ============================================================================
+ * Assembles a source that has already been read in. It calls three functions:
+ * zeroth pass (which handles the extra credit), first pass (which handles
+ * putting the labels into the symbol table) and second pass (which encodes
+ * everything into the text and data images). With the use_single_pass option,
+ * the source is read once instead and forward references are patched as their labels get
+ * defined. With a state file, the lines it has are reused in the second pass and it is
+ * rewritten with this assembly's lines when everything worked. Returns FALSE if there was an
+ * error.
+ * ============================================================================
+ */
+static inline int32_t assemble_source(assembler_t* as, source_t* src)
+{
+	merged_lines_t merged;
+	struct timespec start;
+	trace_span_t span;
+	int32_t ok;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (as->options.use_single_pass == TRUE)
+	{
+		// Reads the source once and encodes as it goes
+		trace_begin(&span, "single_pass");
+		ok = single_pass(as, src);
+		trace_end(&span, NULL);
+		as->seconds[STAGE_SINGLE] = seconds_since(&start);
+		return ok;
+	}
+
+	// Lines from the last assembly. Without a usable state file every line is encoded.
+	if (as->options.state_file != NULL)
+		load_line_states(as->options.state_file, ASSEMBLER_VERSION, &as->previous_lines);
+
+	// Zeroth pass will do the extra credit - it organizies the file into one text and on data section
+	trace_begin(&span, "zeroth_pass");
+	ok = zeroth_pass(src, as->options.threads, &instr_delims, &merged);
+	trace_end(&span, NULL);
+	as->seconds[STAGE_ZEROTH] = seconds_since(&start);
+	if (ok == FALSE)
+	{
+		free_merged_lines(&merged);
+		return assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+	}
+
+	// Handles the symbol table of address for the labels.
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	trace_begin(&span, "first_pass");
+	ok = first_pass(as, &merged);
+	trace_end(&span, NULL);
+	as->seconds[STAGE_FIRST] = seconds_since(&start);
+	if (ok == TRUE)
+	{
+		// Every label is known now, the second pass only looks them up
+		symbol_freeze(as->symbol_table);
+
+		// Handles the output of the assembler
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		trace_begin(&span, "second_pass");
+		ok = second_pass(as, &merged);
+		trace_end(&span, NULL);
+		as->seconds[STAGE_SECOND] = seconds_since(&start);
+	}
+	if (ok == TRUE && as->options.state_file != NULL && save_line_states(as->options.state_file, ASSEMBLER_VERSION, &as->next_lines,
+		as->symbol_table->keys, as->symbol_table->keys_len) == FALSE)
+		ok = assembler_error(as, "ERROR: Unable to write state file %s. Aborting...", as->options.state_file);
+
+	free_merged_lines(&merged);
+	return ok;
+}
+
+/*
+ * ============================================================================
+ * This function perfoms the first pass through the source file. It looks through
+ * the .text section and adds the addresses of all the labels to the
+ * symbol_table hashtable. It then looks through the .data sections and adds
+ * the address of the data into the same hashtable. Returns FALSE if there
+ * was an error.
+ * ============================================================================
+ */
+static inline int32_t first_pass(assembler_t* as, merged_lines_t *merged)
+{
+	char line[MAX_LINE_LENGTH + 1];
+	char data_token[MAX_LINE_LENGTH + 1];
+	char *tok_ptr, *end, *found;
+	int32_t size = 0;
+	token_view_t token;
+	lexed_line_t *lexed;
+	line_t slice;
+	int32_t has_token = FALSE;
+	int32_t next = 0;
+	int32_t text_part = FALSE;
+	int32_t data_part = FALSE;
+
+	while (1)
+	{
+		// Loop thorugh until we reach either .data or .text segments
+		if ((lexed = next_merged_line(merged, &next)) == NULL)
+			break;
+		slice = lexed->line;
+
+		tok_ptr = slice.start;
+		end = slice.start + slice.len;
+
+		has_token = parse_token_view(tok_ptr, end, &section_delims, &tok_ptr, NULL, &token);
+
+		if (has_token == FALSE || *token.start =='#')
+		{
+			// If we had no token or if it was a comment, ignore it
+			continue;
+		}
+		if (token_equals(&token, ".text") || token_equals(&token, ".data"))
+			break;
+	}
+	while (has_token == TRUE)
+	{
+		if (token_equals(&token, ".text"))
+		{
+			text_part = TRUE;
+			as->instr_ptr = TEXT_SEGMENT_START_ADDRESS;
+			// Look at each line and parse the tokens in that line
+			while (1)
+			{
+				if ((lexed = next_merged_line(merged, &next)) == NULL)
+					break;
+				slice = lexed->line;
+
+				// The first token of the line was found when it was lexed
+				has_token = ((lexed->flags & LINE_HAS_TOKEN) != 0);
+				if (has_token == FALSE)
+				{
+					// If we had no token or if it was a comment, ignore it
+					continue;
+				}
+				token = lexed->token;
+
+				// The token was looked up in the opcode table then too
+				found = (char*) lexed->opcode;
+				if (found == NULL)
+				{
+					// If the token was not in the opcode table, look up in the register table
+					found = (char*) (find_register(token.start, token.len));
+					if (found != NULL)
+					{
+						// If the token is a register or a constant, ignore
+						break;
+					}
+				}
+				// See if the token is a label
+				if (memchr(token.start, ':', token.len))
+				{
+					// If the token has a colon, then it is a label
+					// Since it is a label, we store the address we are at into symbol_table
+					if (define_text_label(as, &token, as->instr_ptr) == FALSE)
+						return FALSE;
+				}
+				if (found != NULL)
+				{
+					// If the token is an instruction, increment instr_ptr by its size
+					as->instr_ptr += instr_size(&token);
+				}
+				else if (token_equals(&token, ".data"))
+				{
+					// Break out of the loop if we have data
+					break;
+				}
+				else if (token_equals(&token, "nop"))
+				{
+					// Break out if we have a nop
+					break;
+				}
+			}
+		}
+
+		// Code to handle the .data section
+		else if (token_equals(&token, ".data"))
+		{
+			data_part = TRUE;
+			as->instr_ptr = DATA_SEGMENT_START_ADDRESS;
+			while (1)
+			{
+				if ((lexed = next_merged_line(merged, &next)) == NULL)
+					break;
+				slice = lexed->line;
+
+				tok_ptr = slice.start;
+				end = slice.start + slice.len;
+
+				has_token = parse_token_view(tok_ptr, end, &line_delims, &tok_ptr, NULL, &token);
+
+				if (has_token == FALSE || *token.start =='#')
+				{
+					// If we had no token or if it was a comment, ignore it
+					continue;
+				}
+
+				// The data declarations get chopped up with strtok, so they need their own copies
+				copy_line(line, MAX_LINE_LENGTH, &slice);
+				token_to_str(&token, data_token, sizeof(data_token));
+				if (define_data_line(as, data_token, line, &slice, as->instr_ptr, &size) == FALSE)
+					return FALSE;
+				as->instr_ptr += size;
+			}
+		}
+		// Exit the first pass if we have done both text and data segments
+		if (text_part == TRUE && data_part == TRUE)
+			break;
+
+		// Exit the first pass if we have a nop and we finished doing the data part
+		else if (token_equals(&token, "nop") && data_part == TRUE)
+		{
+			break;
+		}
+
+		// If we have reached a nop and we haven't done data yet, keep looping until we
+		// find ".data"
+		else if (token_equals(&token, "nop") && data_part == FALSE)
+		{
+			while (has_token == TRUE)
+			{
+				if ((lexed = next_merged_line(merged, &next)) == NULL)
+					break;
+				slice = lexed->line;
+
+				tok_ptr = slice.start;
+				end = slice.start + slice.len;
+
+				has_token = parse_token_view(tok_ptr, end, &instr_delims, &tok_ptr, NULL, &token);
+				if (has_token == FALSE || *token.start =='#')
+				{
+					// If we had no token or if it was a comment, ignore it
+					continue;
+				}
+				else
+					break;
+
+			}
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Adds a label from the .text section (still with its colon) to the symbol
+ * table at the given address. A label can't have the same name as an opcode
+ * or a register. Returns FALSE if there was an error.
+ * ============================================================================
+ */
+static inline int32_t define_text_label(assembler_t* as, token_view_t* token, int32_t addr)
+{
+	// Drop the colon, the key is just a view of the label's name
+	char* label = token->start;
+	int32_t len = token->len - 1;
+
+	if (find_opcode(label, len) != NULL)
+	{
+		// If the label was in the opcode table, throw an error, a label can't be the same as
+		// an instruction
+		return assembler_error(as, "ERROR: Label %.*s is the same as an opcode. Aborting...", len, label);
+	}
+
+	if (find_register(label, len) != NULL)
+	{
+		// If the label was the same as a register name, throw an error
+		return assembler_error(as, "ERROR: Label %.*s is the same as a register name. Aborting...", len, label);
+	}
+
+	return insert_symbol(as, label, len, addr, SYMBOL_TEXT_LABEL, 0);
+}
+
+/*
+ * ============================================================================
+ * Handles one line of the .data section for the first pass. token and line
+ * are copies of the line (cut short if it is long) and slice is the line
+ * itself, which strings are read from. If the line declares a label, it is
+ * put in the symbol table at addr. The number of bytes the declaration takes
+ * up goes in bytes. Returns FALSE if there was an error.
+ * ============================================================================
+ */
+static inline int32_t define_data_line(assembler_t* as, char* token, char* line, line_t* slice, int32_t addr, int32_t* bytes)
+{
+	int32_t size_in_bytes = 0;
+	int32_t ok = TRUE;
+	char *save;
+
+	// Handle string data
+	if (strstr(token, ".asciiz") != NULL)
+	{
+		// First, get the label of the token by tokenizing with a colon
+		char* label = strtok_r(token, " \t:", &save);
+		const char *str, *str_end;
+		int32_t len;
+
+		// Then the string itself, from the whole line since it can be long
+		if (find_asciiz(slice->start, slice->start + slice->len, &str, &str_end) == FALSE)
+			return assembler_error(as, "ERROR: The string of %s is missing a quote. Aborting...", label);
+		if (asciiz_length(str, str_end, &len) == FALSE)
+			return assembler_error(as, "ERROR: The string of %s has an unknown escape. Aborting...", label);
+
+		// The second pass packs it into exactly this many words
+		if (asciiz_words(len) > (INT32_MAX - addr) / 4)
+			return assembler_error(as, "ERROR: The string of %s is too long. Aborting...", label);
+		size_in_bytes = asciiz_words(len) * 4;
+
+		ok = insert_symbol(as, label, strlen(label), addr, SYMBOL_ASCIIZ, size_in_bytes);
+	}
+	// Handle word or array data.
+	else if (strstr(token, ".word") != NULL)
+	{
+		int32_t value, size;
+
+		// An array is value:size after the .word, anything else with a label is just an int
+		if (parse_word_array(line, &value, &size) == TRUE)
+		{
+			// Parse by colon to get the label. The initial value isn't needed yet.
+			char* label = strtok_r(token, " \t:", &save);
+
+			if (size < 0 || size > (INT32_MAX - addr) / 4)
+				return assembler_error(as, "ERROR: Array %s has a bad size. Aborting...", label);
+
+			// Increment the address by 4 times the number of elements we are storing
+			size_in_bytes = size * 4;
+
+			ok = insert_symbol(as, label, strlen(label), addr, SYMBOL_WORD, size_in_bytes);
+		}
+		else if (count_num_occurances(line, ':') > 0)
+		{
+			// if it was just an int, parse by colon to get the label and increment the address by four
+			char* label = strtok_r(token, " \t:", &save);
+
+			size_in_bytes = 4;
+
+			ok = insert_symbol(as, label, strlen(label), addr, SYMBOL_WORD, size_in_bytes);
+		}
+	}
+	*bytes = size_in_bytes;
+	return ok;
+}
+
+/*
+ * ============================================================================
+ * Reads the initial value and the number of elements of a "label: .word
+ * value:size" array declaration in line. Returns FALSE if the line doesn't
+ * have them.
+ * ============================================================================
+ */
+static inline int32_t parse_word_array(char* line, int32_t* value, int32_t* size)
+{
+	char *ptr = strstr(line, ".word");
+	char *end;
+
+	if (ptr == NULL)
+		return FALSE;
+	ptr += strlen(".word");
+
+	*value = (int32_t) strtol(ptr, &end, 10);
+	if (end == ptr)
+		return FALSE;
+	ptr = end + strspn(end, " \t");
+	if (*ptr != ':')
+		return FALSE;
+
+	ptr++;
+	*size = (int32_t) strtol(ptr, &end, 10);
+	return (end == ptr) ? FALSE : TRUE;
+}
+
+/*
+ * ============================================================================
+ * Puts the label (len characters long, it does not have to be null
+ * terminated) in the symbol table with its address, what kind of symbol it
+ * is and how many bytes it takes up. In single pass mode, any instructions
+ * that were waiting on this label get encoded now. Returns FALSE if there was
+ * an error.
+ * ============================================================================
+ */
+static inline int32_t insert_symbol(assembler_t* as, char* label, int32_t len, int32_t addr, int32_t kind, int32_t size)
+{
+	symbol_t symbol;
+
+	symbol.address = addr;
+	symbol.section = (kind == SYMBOL_TEXT_LABEL) ? SECTION_TEXT : SECTION_DATA;
+	symbol.size = size;
+	symbol.kind = kind;
+
+	if (symbol_find(as->symbol_table, label, len) != NULL)
+	{
+		// A label can only be defined once
+		return assembler_error(as, "ERROR: Label %.*s is defined more than once. Aborting...", len, label);
+	}
+	if (symbol_insert(as->symbol_table, label, len, &symbol) == FALSE)
+		return assembler_error(as, "ERROR: Count not insert into a hash table. Aborting...");
+
+	if (as->fixup_table != NULL)
+		return resolve_fixups(as, label, len);
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Performs the second pass of the assembly process. It looks thorugh the file,
+ * finds the instructions and works out the address of each one, then encodes
+ * them (see encode_text). Then it reads through the data sections and
+ * converts it into binary. The source is the merged line list from the
+ * zeroth pass. The encoded words go in the text and data images of the
+ * context. Returns FALSE if there was an error.
+ * ============================================================================
+ */
+
+static inline int32_t second_pass(assembler_t* as, merged_lines_t *merged)
+{
+	char line[MAX_LINE_LENGTH + 1];
+	char data_token[MAX_LINE_LENGTH + 1];
+  	char *tok_ptr, *end, *found;
+	token_view_t token;
+	lexed_line_t *lexed;
+	line_t slice;
+	line_key_t key;
+	int32_t has_token = FALSE;
+	int32_t next = 0;
+	int32_t text_part = FALSE;
+	int32_t data_part = FALSE;
+
+	while (1)
+ 	{
+		// Loop thorough until we find a .data or a .text segment
+		if ((lexed = next_merged_line(merged, &next)) == NULL)
+			break;
+		slice = lexed->line;
+
+		tok_ptr = slice.start;
+		end = slice.start + slice.len;
+
+		has_token = parse_token_view(tok_ptr, end, &section_delims, &tok_ptr, NULL, &token);
+		if (has_token == FALSE || *token.start =='#')
+		{
+			// If we had no token or if it was a comment, ignore it
+			continue;
+		}
+		if (token_equals(&token, ".text") || token_equals(&token, ".data"))
+			break;
+
+   	}
+		/* parse the tokens within a line */
+	while (has_token == TRUE)
+   	{
+		if (token_equals(&token, ".text"))
+		{
+			text_line_t *lines = NULL;
+			line_state_t *reused;
+			int32_t count = 0, capacity = 0;
+
+			text_part = TRUE;
+			as->instr_ptr = TEXT_SEGMENT_START_ADDRESS;
+
+			// Every label has an address already, so each line can be encoded on its own.
+			// Collect the lines and the address of each one, then encode them.
+			while (1)
+			{
+				if ((lexed = next_merged_line(merged, &next)) == NULL)
+					break;
+				slice = lexed->line;
+
+				// The first token of the line and its opcode were found when it was lexed
+				has_token = ((lexed->flags & LINE_HAS_TOKEN) != 0);
+				if (has_token == FALSE)
+				{
+					// If we had no token or if it was a comment, ignore it
+					continue;
+				}
+				token = lexed->token;
+				if (token_equals(&token, ".data"))
+					break;
+
+				found = (char*) lexed->opcode;
+				if (found == NULL && !token_equals(&token, "nop") && memchr(token.start, ':', token.len))
+				{
+					// We ignore labels, so we do nothing here
+					continue;
+				}
+
+				// With a state file, find what the last assembly had for the line (see encode_text_incremental)
+				reused = NULL;
+				if (as->options.state_file != NULL)
+				{
+					line_key(slice.start, slice.len, &key);
+					reused = next_line_state(&as->previous_lines, &key);
+				}
+
+				if (count == capacity)
+				{
+					text_line_t *bigger;
+					capacity = (capacity == 0) ? 1024 : capacity * 2;
+					bigger = (text_line_t*) counted_realloc(lines, sizeof(text_line_t) * capacity);
+					if (bigger == NULL)
+					{
+						free(lines);
+						return assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+					}
+					lines = bigger;
+				}
+				lines[count].slice = slice;
+				lines[count].pc = as->instr_ptr;
+				lines[count].reused = reused;
+				count++;
+
+				// Anything that is not an instruction is reported when it gets encoded
+				as->instr_ptr += (found != NULL) ? instr_size(&token) : 4;
+			}
+
+			if (encode_text(as, lines, count) == FALSE)
+			{
+				free(lines);
+				return FALSE;
+			}
+			free(lines);
+		}
+
+		else if (token_equals(&token, ".data"))
+		{
+			data_part = TRUE;
+			as->instr_ptr = DATA_SEGMENT_START_ADDRESS;
+			while (1)
+			{
+				if ((lexed = next_merged_line(merged, &next)) == NULL)
+					break;
+				slice = lexed->line;
+
+				tok_ptr = slice.start;
+				end = slice.start + slice.len;
+
+				has_token = parse_token_view(tok_ptr, end, &line_delims, &tok_ptr, NULL, &token);
+				if (has_token == FALSE || *token.start == '#')
+				{
+					continue;
+				}
+
+				// The data declarations get chopped up with strtok, so they need their own copies
+				copy_line(line, MAX_LINE_LENGTH, &slice);
+				token_to_str(&token, data_token, sizeof(data_token));
+				if (emit_data_line(as, data_token, line, &slice, &as->data) == FALSE)
+					return FALSE;
+			}
+			break;
+		}
+		if (text_part == TRUE && data_part == TRUE)
+				break;
+		else if (token_equals(&token, "nop") && data_part == TRUE)
+		{
+			break;
+		}
+		else if (token_equals(&token, "nop") && data_part == FALSE)
+		{
+			while (1)
+			{
+				if ((lexed = next_merged_line(merged, &next)) == NULL)
+					break;
+				slice = lexed->line;
+
+				tok_ptr = slice.start;
+				end = slice.start + slice.len;
+
+				has_token = parse_token_view(tok_ptr, end, &instr_delims, &tok_ptr, NULL, &token);
+				if (has_token == FALSE || *token.start =='#')
+				{
+					// If we had no token or if it was a comment, ignore it
+					continue;
+				}
+				else
+					break;
+
+			}
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Encodes the text segment lines into the text image. With a state file the
+ * lines are encoded incrementally (see encode_text_incremental), otherwise
+ * all of them are encoded (see encode_text_chunks). Returns FALSE if there
+ * was an error.
+ * ============================================================================
+ */
+static inline int32_t encode_text(assembler_t* as, text_line_t* lines, int32_t count)
+{
+	if (as->options.state_file != NULL)
+		return encode_text_incremental(as, lines, count);
+	return encode_text_chunks(as, lines, count, NULL);
+}
+
+/*
+ * ============================================================================
+ * Encodes the text lines, into the text image or, if states is set, each
+ * into its own state (see encode_text_states). When the context may use more
+ * than one thread and there are enough lines, they are split into chunks
+ * that are encoded at the same time into their own images, which are then
+ * added to the text image in program order, so the words come out the same
+ * as encoding them one after another. If several chunks fail, the error from
+ * the first one is kept, which is the one the serial encoding would have
+ * stopped at. Returns FALSE if there was an error.
+ * ============================================================================
+ */
+static inline int32_t encode_text_chunks(assembler_t* as, text_line_t* lines, int32_t count, line_state_t* states)
+{
+	encode_chunk_t chunks[MAX_ENCODE_THREADS];
+	pthread_t threads[MAX_ENCODE_THREADS];
+	int32_t started[MAX_ENCODE_THREADS];
+	int32_t num_chunks = as->options.threads;
+	int32_t ok = TRUE;
+	int32_t i, j;
+
+	if (num_chunks > count / MIN_ENCODE_CHUNK)
+		num_chunks = count / MIN_ENCODE_CHUNK;
+	if (num_chunks <= 1 && states != NULL)
+		return encode_text_states(as, lines, count, states);
+	if (num_chunks <= 1)
+		return encode_text_lines(as, lines, count, &as->text);
+
+	for (i = 0; i < num_chunks; i++)
+	{
+		int32_t first = (int32_t)((int64_t) count * i / num_chunks);
+		int32_t last = (int32_t)((int64_t) count * (i + 1) / num_chunks);
+
+		chunks[i].as = *as;
+		chunks[i].as.error[0] = '\0';
+		memset(&chunks[i].as.text, 0, sizeof(word_image_t));
+		chunks[i].as.text.address = lines[first].pc;
+		chunks[i].lines = lines + first;
+		chunks[i].count = last - first;
+		chunks[i].states = (states == NULL) ? NULL : states + first;
+		chunks[i].ok = FALSE;
+
+		// The first chunk is done in this thread, and so is any chunk we can't start a thread for
+		started[i] = (i > 0 && pthread_create(&threads[i], NULL, encode_worker, &chunks[i]) == 0);
+	}
+	for (i = 0; i < num_chunks; i++)
+	{
+		if (started[i] == FALSE)
+			encode_worker(&chunks[i]);
+	}
+	for (i = 0; i < num_chunks; i++)
+	{
+		if (started[i] == TRUE)
+		{
+			pthread_join(threads[i], NULL);
+			add_counters(&chunks[i].counters);
+		}
+	}
+
+	for (i = 0; i < num_chunks; i++)
+	{
+		if (ok == TRUE && chunks[i].ok == FALSE)
+			ok = assembler_error(as, "%s", chunks[i].as.error);
+		for (j = 0; ok == TRUE && j < chunks[i].as.text.stored; j++)
+			ok = emit_word(as, &as->text, chunks[i].as.text.words[j]);
+		free_word_image(&chunks[i].as.text);
+	}
+	return ok;
+}
+
+/*
+ * ============================================================================
+ * An encoding thread. Encodes one chunk of the text segment.
+ * ============================================================================
+ */
+static inline void* encode_worker(void* arg)
+{
+	encode_chunk_t *chunk = (encode_chunk_t*) arg;
+	run_counters_t saved;
+	trace_span_t span;
+
+	trace_begin(&span, "encode_chunk");
+	begin_counting(&saved);
+	if (chunk->states != NULL)
+		chunk->ok = encode_text_states(&chunk->as, chunk->lines, chunk->count, chunk->states);
+	else
+		chunk->ok = encode_text_lines(&chunk->as, chunk->lines, chunk->count, &chunk->as.text);
+	end_counting(&saved, &chunk->counters);
+	trace_end(&span, NULL);
+	return NULL;
+}
+
+/*
+ * ============================================================================
+ * Encodes each text line and adds its words to image. Returns FALSE at the
+ * first line that can't be encoded.
+ * ============================================================================
+ */
+static inline int32_t encode_text_lines(assembler_t* as, text_line_t* lines, int32_t count, word_image_t* image)
+{
+	line_state_t state;
+	int32_t n, i;
+
+	for (n = 0; n < count; n++)
+	{
+		if (encode_text_line(as, &lines[n], &state, NULL) == FALSE)
+			return FALSE;
+		for (i = 0; i < state.num_words; i++)
+		{
+			if (emit_word(as, image, state.words[i]) == FALSE)
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Encodes each text line into its state, for the next state file: its
+ * words, its key and what it depends on. The label of a state is where the
+ * name of the label it uses is in the symbol table's keys, or -1. Returns
+ * FALSE at the first line that can't be encoded.
+ * ============================================================================
+ */
+static inline int32_t encode_text_states(assembler_t* as, text_line_t* lines, int32_t count, line_state_t* states)
+{
+	char label[MAX_LINE_LENGTH + 1];
+	symbol_entry_t *entry;
+	int32_t n;
+
+	for (n = 0; n < count; n++)
+	{
+		if (encode_text_line(as, &lines[n], &states[n], label) == FALSE)
+			return FALSE;
+		line_key(lines[n].slice.start, lines[n].slice.len, &states[n].key);
+		states[n].dependency = 0;
+		states[n].label = -1;
+		if (label[0] != '\0')
+		{
+			// It was just encoded, so the label is there
+			entry = symbol_find_entry(as->symbol_table, label, strlen(label));
+			states[n].label = entry->key_offset;
+			states[n].dependency = entry->symbol.address - ((states[n].pc_relative == TRUE) ? lines[n].pc : 0);
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Encodes the text lines into the text image, reusing the words of every
+ * line the last assembly already encoded (see incremental.h). A line is
+ * reused when its text has the same key and the label it names, if any, is
+ * at the same address, or for beq and bne the same distance away. The
+ * other lines are encoded first, in as many threads as encode_text_chunks
+ * would use, and then every line's words are added in program order. lines
+ * is reordered on the way. The lines of this assembly go in next_lines to be saved for the next one, with
+ * their labels pointing into the symbol table's keys. Returns FALSE if there
+ * was an error.
+ * ============================================================================
+ */
+static inline int32_t encode_text_incremental(assembler_t* as, text_line_t* lines, int32_t count)
+{
+	line_state_t *states;
+	line_state_t *encoded = NULL;
+	line_state_t *found;
+	line_state_t *state;
+	symbol_entry_t *entry;
+	const char *name;
+	int32_t num_missed = 0;
+	int32_t ok = TRUE;
+	int32_t n, m, i;
+
+	states = (line_state_t*) counted_malloc(sizeof(line_state_t) * (count + 1));
+	if (states == NULL || reserve_line_states(&as->next_lines, count) == FALSE)
+	{
+		free(states);
+		return assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+	}
+
+	// Every line starts out as what the last assembly had for its text, if anything
+	for (n = 0; n < count; n++)
+	{
+		found = lines[n].reused;
+		if (found != NULL && found->label >= 0)
+		{
+			// Same text, so same label. The words hold if it is where it was as seen from this line.
+			name = as->previous_lines.labels + found->label;
+			entry = symbol_find_entry(as->symbol_table, name, strlen(name));
+			if (entry == NULL)
+				found = NULL;
+			else
+			{
+				int32_t dependency = entry->symbol.address - ((found->pc_relative == TRUE) ? lines[n].pc : 0);
+				if (found->dependency != dependency)
+					found = match_line_state(&as->previous_lines, &found->key, dependency);
+				if (found != NULL)
+				{
+					states[n] = *found;
+					states[n].label = entry->key_offset;
+				}
+			}
+		}
+		else if (found != NULL)
+			states[n] = *found;
+
+		if (found == NULL)
+		{
+			states[n].num_words = 0;
+			lines[num_missed++] = lines[n];
+		}
+	}
+
+	// Encode the lines that can't be reused, which were moved to the front of lines in order
+	encoded = (line_state_t*) counted_malloc(sizeof(line_state_t) * (num_missed + 1));
+	if (encoded == NULL)
+		ok = assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+	if (ok == TRUE)
+		ok = encode_text_chunks(as, lines, num_missed, encoded);
+
+	for (n = 0, m = 0; ok == TRUE && n < count; n++)
+	{
+		if (states[n].num_words > 0)
+		{
+			state = &states[n];
+			as->lines_reused++;
+		}
+		else
+		{
+			state = &encoded[m++];
+			as->lines_encoded++;
+		}
+
+		for (i = 0; ok == TRUE && i < state->num_words; i++)
+			ok = emit_word(as, &as->text, state->words[i]);
+		if (ok == TRUE && state->num_words > 0 && add_line_state(&as->next_lines, state) == FALSE)
+			ok = assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+	}
+
+	free(states);
+	free(encoded);
+	return ok;
+}
+
+/*
+ * ============================================================================
+ * Decodes a text line, classifies it as either r-type, j-type or i-type, and
+ * puts its words in state->words and how many there are in state->num_words.
+ * A nop is a word of 0s. If label is not NULL, the name of the label the
+ * line uses is copied into it ("" if there is none) and state->pc_relative
+ * is set for a branch. Returns FALSE if the line can't be encoded.
+ * ============================================================================
+ */
+static inline int32_t encode_text_line(assembler_t* as, text_line_t* line, line_state_t* state, char* label)
+{
+	char *tok_ptr = line->slice.start;
+	char *end = line->slice.start + line->slice.len;
+	token_view_t token;
+
+	state->num_words = 0;
+	state->pc_relative = FALSE;
+	if (label != NULL)
+		label[0] = '\0';
+
+	// Every line here was found to have a token when it was collected
+	if (parse_token_view(tok_ptr, end, &instr_delims, &tok_ptr, NULL, &token) == FALSE)
+		return TRUE;
+
+	// Look in our op code table to see if it is an instrction we know
+	if (find_opcode(token.start, token.len) != NULL)
+	{
+		char inst[MAX_LINE_LENGTH + 1];
+		char operand_buf[3][MAX_LINE_LENGTH + 1];
+		char *operands[3];
+		char *used;
+
+		// Get the arguments of the instruction and convert it to binary
+		token_to_str(&token, inst, sizeof(inst));
+		parse_operands(inst, &tok_ptr, end, operand_buf, operands);
+		if (encode_instr(as, inst, operands, line->pc, state->words) == FALSE)
+			return FALSE;
+		state->num_words = instr_size(&token) / 4;
+
+		if (label != NULL && (used = instr_label(inst, operands)) != NULL)
+		{
+			strcpy(label, used);
+			state->pc_relative = (strcmp(inst, "beq") == 0 || strcmp(inst, "bne") == 0);
+		}
+	}
+	else if (token_equals(&token, "nop"))
+	{
+		// If the instrucition was just a nop, put out a word of 0s
+		state->words[0] = 0;
+		state->num_words = 1;
+	}
+	else
+	{
+		// If the instruction we not one of the one we know, throw an error
+		return assembler_error(as, "ERROR: Instruction %.*s not found. Aborting...", (int) token.len, token.start);
+	}
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Puts one line of the .data section into the data image. Strings are packed
+ * four characters to a word, a .word is one word and an array is one word for
+ * each element. token, line and slice are as for define_data_line. Returns
+ * FALSE if there was an error.
+ * ============================================================================
+ */
+static inline int32_t emit_data_line(assembler_t* as, char* token, char* line, line_t* slice, word_image_t* data)
+{
+	char *save;
+
+	if (strstr(token, ".asciiz") != NULL)
+	{
+		const char *str, *str_end;
+		int32_t len;
+
+		// The first pass has already checked the string
+		if (find_asciiz(slice->start, slice->start + slice->len, &str, &str_end) == TRUE &&
+			asciiz_length(str, str_end, &len) == TRUE)
+			return parse_asciiz(as, str, str_end, len, data);
+	}
+	else if (strstr(token, ".word") != NULL)
+	{
+		int32_t initial_value, size;
+
+		// An array is value:size after the .word, anything else with a label is just an int
+		if (parse_word_array(line, &initial_value, &size) == TRUE)
+		{
+			// Put the initial value in all size words at once, as a run if there are
+			// enough of them. The first pass checked the size.
+			if (add_words(data, (uint32_t) initial_value, size) == FALSE)
+				return assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+		}
+		else if (count_num_occurances(line, ':') > 0)
+		{
+			// If it was just a number, put that number in a word
+		    strtok_r(token, ":", &save);
+			strtok_r(NULL, ".word", &save);
+			char* amount = strtok_r(NULL, ".word \t", &save);
+			int32_t value = (amount == NULL) ? 0 : (int32_t)(atoi(amount));
+			return emit_word(as, data, (uint32_t) value);
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Adds a word to the end of a segment image. Returns FALSE if we ran out of
+ * memory.
+ * ============================================================================
+ */
+static inline int32_t emit_word(assembler_t* as, word_image_t* image, uint32_t word)
+{
+	if (add_word(image, word) == FALSE)
+	{
+		// Check to see if we were able to grow the image.
+		return assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+	}
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Single pass assembly. Reads the source file once, gathering the .text and
+ * .data sections the same way the zeroth pass does. Every instruction is
+ * encoded as soon as it is read. If it uses a label we have not seen yet
+ * (beq/bne/j/jal/la), it goes on that label's fixup list instead and gets
+ * encoded when the label is defined. Both segments are kept in memory until
+ * the whole file has been read, and end up in the text and data images of
+ * the context. Returns FALSE if there was an error.
+ * ============================================================================
+ */
+static inline int32_t single_pass(assembler_t* as, source_t *src)
+{
+	char line[MAX_LINE_LENGTH + 1];
+	char data_token[MAX_LINE_LENGTH + 1];
+	char *tok_ptr, *found;
+	char *cursor = src->data;
+	char *end = src->data + src->len;
+	token_view_t token;
+	line_t slice;
+	int32_t size;
+	int32_t text_pc = TEXT_SEGMENT_START_ADDRESS;
+	int32_t data_pc = DATA_SEGMENT_START_ADDRESS;
+	int32_t data_part = FALSE;
+	int32_t slot, i;
+
+	as->fixup_table = create_hash_table(127);
+	if (as->fixup_table == NULL)
+		return assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+
+	while (next_line(&cursor, end, &slice) == TRUE)
+	{
+		char *line_end = slice.start + slice.len;
+
+		if (data_part == FALSE)
+		{
+			if (line_contains(&slice, ".data") == TRUE)
+			{
+				data_part = TRUE;
+				continue;
+			}
+			// Like the zeroth pass, drop the .text markers and the nops. We put one nop back at the end.
+			if (line_contains(&slice, "nop") == TRUE || line_contains(&slice, ".text") == TRUE)
+				continue;
+
+			tok_ptr = slice.start;
+			if (parse_token_view(tok_ptr, line_end, &instr_delims, &tok_ptr, NULL, &token) == FALSE || *token.start =='#')
+			{
+				// If we had no token or if it was a comment, ignore it
+				continue;
+			}
+
+			found = (char*) (find_opcode(token.start, token.len));
+			if (found != NULL)
+			{
+				char inst[MAX_LINE_LENGTH + 1];
+				char operand_buf[3][MAX_LINE_LENGTH + 1];
+				char *operands[3];
+				char *label;
+
+				token_to_str(&token, inst, sizeof(inst));
+				parse_operands(inst, &tok_ptr, line_end, operand_buf, operands);
+				label = instr_label(inst, operands);
+				slot = add_text_slot(as);
+				if (slot < 0)
+					return FALSE;
+				as->text_image[slot].num_words = instr_size(&token) / 4;
+				if (label != NULL && symbol_find(as->symbol_table, label, strlen(label)) == NULL)
+				{
+					// Forward reference, encode it once the label is defined
+					if (add_fixup(as, inst, operands, text_pc, slot) == FALSE)
+						return FALSE;
+				}
+				else
+				{
+					if (encode_instr(as, inst, operands, text_pc, as->text_image[slot].words) == FALSE)
+						return FALSE;
+				}
+				text_pc += instr_size(&token);
+			}
+			else if (memchr(token.start, ':', token.len))
+			{
+				if (define_text_label(as, &token, text_pc) == FALSE)
+					return FALSE;
+			}
+			else
+			{
+				return assembler_error(as, "ERROR: Instruction %.*s not found. Aborting...", (int) token.len, token.start);
+			}
+		}
+		else
+		{
+			if (line_contains(&slice, ".text") == TRUE)
+			{
+				data_part = FALSE;
+				continue;
+			}
+			if (line_contains(&slice, ".data") == TRUE)
+				continue;
+
+			tok_ptr = slice.start;
+			if (parse_token_view(tok_ptr, line_end, &line_delims, &tok_ptr, NULL, &token) == FALSE || *token.start =='#')
+			{
+				// If we had no token or if it was a comment, ignore it
+				continue;
+			}
+
+			// The data declarations get chopped up with strtok, so they need their own copies
+			copy_line(line, MAX_LINE_LENGTH, &slice);
+			token_to_str(&token, data_token, sizeof(data_token));
+			if (define_data_line(as, data_token, line, &slice, data_pc, &size) == FALSE)
+				return FALSE;
+			data_pc += size;
+
+			token_to_str(&token, data_token, sizeof(data_token));
+			if (emit_data_line(as, data_token, line, &slice, &as->data) == FALSE)
+				return FALSE;
+		}
+	}
+
+	// The text segment always ends with a nop
+	slot = add_text_slot(as);
+	if (slot < 0)
+		return FALSE;
+	as->text_image[slot].words[0] = 0;
+
+	for (i = 0; i < as->text_image_size; i++)
+	{
+		if (as->text_image[i].fixup != NULL)
+			return assembler_error(as, "ERROR: Cannot find label %s. Aborting...", as->text_image[i].fixup->label);
+	}
+
+	symbol_freeze(as->symbol_table);
+
+	for (i = 0; i < as->text_image_size; i++)
+	{
+		int32_t j;
+		for (j = 0; j < as->text_image[i].num_words; j++)
+		{
+			if (emit_word(as, &as->text, as->text_image[i].words[j]) == FALSE)
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Adds an empty slot to the end of the in-memory text segment and returns
+ * its index, or -1 if we ran out of memory.
+ * ============================================================================
+ */
+static inline int32_t add_text_slot(assembler_t* as)
+{
+	if (as->text_image_size == as->text_image_capacity)
+	{
+		int32_t capacity = (as->text_image_capacity == 0) ? 256 : as->text_image_capacity * 2;
+		text_slot_t *slots = (text_slot_t*)(counted_realloc(as->text_image, sizeof(text_slot_t) * capacity));
+		if (slots == NULL)
+		{
+			// Check to see if realloc failed.
+			assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+			return -1;
+		}
+		as->text_image = slots;
+		as->text_image_capacity = capacity;
+	}
+	as->text_image[as->text_image_size].words[0] = as->text_image[as->text_image_size].words[1] = 0;
+	as->text_image[as->text_image_size].num_words = 1;
+	as->text_image[as->text_image_size].fixup = NULL;
+	return as->text_image_size++;
+}
+
+/*
+ * ============================================================================
+ * Records that the instruction in the given text slot is waiting on the
+ * label it uses. The instruction and its operands are copied into the arena,
+ * since they only live as long as the line they came from. The fixup table
+ * maps each label to the list of instructions that use it. Returns FALSE if
+ * we ran out of memory.
+ * ============================================================================
+ */
+static inline int32_t add_fixup(assembler_t* as, char* inst, char** operands, int32_t pc, int32_t slot)
+{
+	fixup_t **head;
+	fixup_t *fixup = (fixup_t*)(arena_alloc(&as->arena, sizeof(fixup_t)));
+	int32_t ok;
+	int32_t i;
+	if (fixup == NULL)
+	{
+		// Check to see if malloc failed.
+		return assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+	}
+
+	fixup->inst = arena_strdup(&as->arena, inst);
+	ok = (fixup->inst != NULL);
+	for (i = 0; i < 3; i++)
+	{
+		fixup->operands[i] = (operands[i] == NULL) ? NULL : arena_strdup(&as->arena, operands[i]);
+		if (operands[i] != NULL && fixup->operands[i] == NULL)
+			ok = FALSE;
+	}
+	if (ok == FALSE)
+		return assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+	fixup->label = instr_label(fixup->inst, fixup->operands);
+	fixup->pc = pc;
+	fixup->slot = slot;
+	fixup->next = NULL;
+	as->text_image[slot].fixup = fixup;
+
+	head = (fixup_t**)(hash_find(as->fixup_table, fixup->label, strlen(fixup->label)));
+	if (head == NULL)
+	{
+		head = (fixup_t**)(arena_alloc(&as->arena, sizeof(fixup_t*)));
+		if (head == NULL || hash_insert(as->fixup_table, fixup->label, strlen(fixup->label), head) == FALSE)
+			return assembler_error(as, "ERROR: Count not insert into a hash table. Aborting...");
+		*head = NULL;
+	}
+
+	fixup->next = *head;
+	*head = fixup;
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * Encodes every instruction that was waiting on label, now that it is in the
+ * symbol table, and drops the label's fixup list. Returns FALSE if one of
+ * them could not be encoded.
+ * ============================================================================
+ */
+static inline int32_t resolve_fixups(assembler_t* as, char* label, int32_t len)
+{
+	fixup_t **head = (fixup_t**)(hash_find(as->fixup_table, label, len));
+	fixup_t *fixup;
+	int32_t ok = TRUE;
+	if (head == NULL)
+		return TRUE;
+
+	for (fixup = *head; fixup != NULL; fixup = fixup->next)
+	{
+		if (ok == TRUE)
+			ok = encode_instr(as, fixup->inst, fixup->operands, fixup->pc, as->text_image[fixup->slot].words);
+		as->text_image[fixup->slot].fixup = NULL;
+	}
+	// The fixups stay in the arena until the context is freed
+	hash_delete(as->fixup_table, label, len);
+	return ok;
+}
+
+/*
+ * ============================================================================
+ * Gets the arguments of an instruction from the rest of the line, up to end.
+ * They are copied into operand_buf in the order they are written in, and
+ * operands points at them (or is NULL for a missing one).
+ * ============================================================================
+ */
+static inline void parse_operands(char* inst, char** tok_ptr, char* end, char operand_buf[][MAX_LINE_LENGTH + 1], char** operands)
+{
+	operands[0] = operands[1] = operands[2] = NULL;
+	if (strcmp(inst, "jr") == 0)
+	{
+		// jr only has the register we are jumping to
+		operands[0] = next_operand(tok_ptr, end, &last_operand_delims, operand_buf[0]);
+	}
+	else if (strcmp(inst, "add") == 0 || strcmp(inst, "sub") == 0 || strcmp(inst, "or") == 0 ||
+		strcmp(inst, "and") == 0 || strcmp(inst, "slt") == 0 || strcmp(inst, "sll") == 0 ||
+		strcmp(inst, "srl") == 0 || strcmp(inst, "addi") == 0 || strcmp(inst, "ori") == 0 ||
+		strcmp(inst, "andi") == 0 || strcmp(inst, "slti") == 0 || strcmp(inst, "beq") == 0 ||
+		strcmp(inst, "bne") == 0)
+	{
+		// Three registers, or two registers and an immediate field
+		operands[0] = next_operand(tok_ptr, end, &operand_delims, operand_buf[0]);
+		operands[1] = next_operand(tok_ptr, end, &operand_delims, operand_buf[1]);
+		operands[2] = next_operand(tok_ptr, end, &last_operand_delims, operand_buf[2]);
+	}
+	else if (strcmp(inst, "lw") == 0 || strcmp(inst, "sw") == 0)
+	{
+		// The register, then the offset and the base register from offset(base)
+		operands[0] = next_operand(tok_ptr, end, &mem_operand_delims, operand_buf[0]);
+		operands[1] = next_operand(tok_ptr, end, &mem_operand_delims, operand_buf[1]);
+		operands[2] = next_operand(tok_ptr, end, &last_mem_operand_delims, operand_buf[2]);
+	}
+	else if (strcmp(inst, "j") == 0 || strcmp(inst, "jal") == 0)
+	{
+		// Just the label we are jumping to
+		operands[0] = next_operand(tok_ptr, end, &last_mem_operand_delims, operand_buf[0]);
+	}
+	else if (strcmp(inst, "la") == 0)
+	{
+		// The register we are loading into and the label
+		operands[0] = next_operand(tok_ptr, end, &last_mem_operand_delims, operand_buf[0]);
+		operands[1] = next_operand(tok_ptr, end, &last_mem_operand_delims, operand_buf[1]);
+	}
+}
+
+/*
+ * ============================================================================
+ * Gets the next operand token and copies it into buf. Returns buf, or NULL if
+ * there was nothing left on the line.
+ * ============================================================================
+ */
+static inline char* next_operand(char** tok_ptr, char* end, delim_set_t* delims, char* buf)
+{
+	token_view_t token;
+
+	if (parse_token_view(*tok_ptr, end, delims, tok_ptr, NULL, &token) == FALSE)
+		return NULL;
+	return token_to_str(&token, buf, MAX_LINE_LENGTH + 1);
+}
+
+/*
+ * ============================================================================
+ * Returns the operand of the instruction that names a label, or NULL if the
+ * instruction does not use one.
+ * ============================================================================
+ */
+static inline char* instr_label(char* inst, char** operands)
+{
+	if (strcmp(inst, "beq") == 0 || strcmp(inst, "bne") == 0)
+		return operands[2];
+	if (strcmp(inst, "j") == 0 || strcmp(inst, "jal") == 0)
+		return operands[0];
+	if (strcmp(inst, "la") == 0)
+		return operands[1];
+	return NULL;
+}
+
+/*
+ * ============================================================================
+ * Returns how many bytes an instruction takes up. la turns into lui and ori,
+ * so it takes 8 bytes. Everything else is 4.
+ * ============================================================================
+ */
+static inline int32_t instr_size(token_view_t* inst)
+{
+	if (token_equals(inst, "la"))
+		return 8;
+	return 4;
+}
+
+/*
+ * ============================================================================
+ * Converts an instruction into machine code, given the operands from
+ * parse_operands and the address of the instruction. The words go in words
+ * (two of them for la). Returns FALSE if the instruction could not be
+ * encoded.
+ * ============================================================================
+ */
+static inline int32_t encode_instr(assembler_t* as, char* inst, char** operands, int32_t pc, uint32_t* words)
+{
+	if (strcmp(inst, "jr") == 0)
+	{
+		// If our instruction is a jr, we only need to get one register, the other arguments
+		// to our process_r_type_instr functions are null
+		return process_r_type_instr(as, inst, operands[0], NULL, NULL, words);
+	}
+	else if (strcmp(inst, "add") == 0 || strcmp(inst, "sub") == 0 || strcmp(inst, "or") == 0 ||
+		strcmp(inst, "and") == 0 || strcmp(inst, "slt") == 0 || strcmp(inst, "sll") == 0 ||
+		strcmp(inst, "srl") == 0)
+	{
+		// All the other r type instructions need three registers to be processed
+		return process_r_type_instr(as, inst, operands[0], operands[1], operands[2], words);
+	}
+	else if (strcmp(inst, "addi") == 0 || strcmp(inst, "ori") == 0 || strcmp(inst, "andi") == 0
+		|| strcmp(inst, "slti") == 0 || strcmp(inst, "beq") == 0 || strcmp(inst, "bne") == 0)
+	{
+		// These i-type instrucions need two registers and an immediate field to be parserd. I also
+		// pass in the current instruction pointer to calculate offsets for branches
+		return process_i_type_instr(as, inst, operands[0], operands[1], operands[2], pc, words);
+	}
+	else if (strcmp(inst, "lw") == 0 || strcmp(inst, "sw") == 0)
+	{
+		// For lw and sw we need to get the dest register, source register and the immediate offset
+		return process_i_type_instr(as, inst, operands[0], operands[2], operands[1], pc, words);
+	}
+	else if (strcmp(inst, "j") == 0 || strcmp(inst, "jal") == 0)
+	{
+		// For jal and j, we just need the label we are jumping too
+		return process_j_type_instr(as, inst, operands[0], words);
+	}
+	else if (strcmp(inst, "la") == 0)
+	{
+		// For la, get the label of the address we are tyring to load and the register we want to load it to
+		return process_psuedo_instr(as, inst, operands[0], operands[1], words);
+	}
+
+	return assembler_error(as, "ERROR: Instruction %s not found. Aborting...", inst);
+}
+
+/*
+ * =============================================================================
+ * Process r type instructions. Need the instruction and three registers - rs, 
+ * rt, rd. The instruction is put together in word.
+ * =============================================================================
+ */
+static inline int32_t process_r_type_instr(assembler_t* as, char* inst, char* rs, char* rt, char* rd, uint32_t* word)
+{
+	const opcode_entry_t *code;
+	const register_entry_t *src1, *src2, *dest;
+
+	if (strcmp(inst, "jr") == 0)
+	{
+		// For jr we only need the register we are jumping to (rs)
+		if (rs == NULL)
+		{
+			return assembler_error(as, "ERROR: Cannot parse command %s. Incorrect arguments. Aborting...", inst);
+		}
+		src1 = find_register(rs, strlen(rs));
+		if (src1 == NULL)
+		{
+			return assembler_error(as, "ERROR: Cannot parse command %s, Incorrect arguments. Aborting...", inst);
+		}
+		code = find_opcode(inst, strlen(inst));
+		*word = ENCODE_R_TYPE(src1->number, 0, 0, 0, code->funct);
+	}
+	// If any of the given registers are null, we have wrong arguments for this instruction
+	else if (rt == NULL || rs == NULL || rd == NULL)
+	{
+		return assembler_error(as, "ERROR: Cannot parse command %s. Incorrect arguments. Aborting...", inst);
+	}
+	else if (strcmp(inst, "add") == 0 || strcmp(inst, "sub") == 0 || strcmp(inst, "or") == 0 ||
+		strcmp(inst, "and") == 0 || strcmp(inst, "slt") == 0)
+	{
+		// For these instructions, we need all three registers, and a function, which identifies it 
+		src1 = find_register(rt, strlen(rt));
+		src2 = find_register(rd, strlen(rd));
+		dest = find_register(rs, strlen(rs)); 
+		if (src1 == NULL || src2 == NULL || dest == NULL)
+		{
+			return assembler_error(as, "ERROR: Cannot parse command %s. Incorrect arguments. Aborting...", inst);
+		}
+		code = find_opcode(inst, strlen(inst));
+		*word = ENCODE_R_TYPE(src1->number, src2->number, dest->number, 0, code->funct);
+	}
+	else if (strcmp(inst, "sll") == 0 || strcmp(inst, "srl") == 0)
+	{
+		// For these instructions, we need two registers, and a shift amount
+		src2 = find_register(rt, strlen(rt));
+		dest = find_register(rs, strlen(rs));
+ 		if (src2 == NULL || dest == NULL)
+		{
+			
+			return assembler_error(as, "ERROR: Cannot parse command %s. Incorrect arguments. Aborting...", inst);
+		} 
+		code = find_opcode(inst, strlen(inst));
+		*word = ENCODE_R_TYPE(0, src2->number, dest->number, (uint32_t) atoi(rd), code->funct);
+	}
+	return TRUE;
+}
+
+/*
+ * ==================================================================================
+ * For the i-type instructions, we need the instructions, two registers and an
+ * immediate field. We also pass in the current pc to calculate offsets
+ * ==================================================================================
+ */
+static inline int32_t process_i_type_instr(assembler_t* as, char* inst, char* rs, char* rt, char* imm, int32_t pc, uint32_t* word)
+{
+	const opcode_entry_t *code;
+	const register_entry_t *src1, *src2;
+
+	if (rt == NULL || rs == NULL || imm == NULL)
+	{
+		return assembler_error(as, "ERROR: Cannot parse command %s. Incorrect arguments. Aborting...", inst);
+	}
+	else if (strcmp(inst, "addi") == 0 || strcmp(inst, "ori") == 0 || 
+		strcmp(inst, "andi") == 0 || strcmp(inst, "slti") == 0 )
+	{
+		// get the opcode, registers and the imm field
+		code = find_opcode(inst, strlen(inst));
+		src1 = find_register(rt, strlen(rt));
+		src2 = find_register(rs, strlen(rs));
+		if (src1 == NULL || src2 == NULL)
+		{
+			return assembler_error(as, "ERROR: Cannot parse command %s. Incorrect arguments. Aborting...", inst);
+		}
+		*word = ENCODE_I_TYPE(code->opcode, src1->number, src2->number, (uint32_t) atoi(imm));
+	}
+
+	else if (strcmp(inst, "bne") == 0 || strcmp(inst, "beq") == 0)
+	{
+		// For these instructions, we need the opcode, two registers and the
+		// offset from the current pc to the location of the label
+		code = find_opcode(inst, strlen(inst));
+		src1 = find_register(rs, strlen(rs));
+		src2 = find_register(rt, strlen(rt));
+		
+		symbol_t* found = symbol_find(as->symbol_table, imm, strlen(imm));
+		if (found == NULL)
+		{	
+			return assembler_error(as, "ERROR: Cannot find label %s. Aborting...", imm);
+		}
+		int32_t addr_of_label = found->address;
+
+		int32_t offset = (addr_of_label - (4 + pc)) / 4;
+
+		if (src1 == NULL || src2 == NULL)
+		{
+			return assembler_error(as, "ERROR: Cannot parse command %s. Incorrect arguments. Aborting...", inst);
+		}
+		*word = ENCODE_I_TYPE(code->opcode, src1->number, src2->number, (uint32_t) offset);
+	}
+	else if (strcmp(inst, "lw") == 0 || strcmp(inst, "sw") == 0)
+	{
+		// For these two instructions, we need the opcode, a source register, destination register,
+		// and a immediate field for the offset
+		code = find_opcode(inst, strlen(inst));
+		src1 = find_register(rt, strlen(rt));
+		src2 = find_register(rs, strlen(rs));
+		if (src1 == NULL || src2 == NULL)
+		{
+			return assembler_error(as, "ERROR: Cannot parse command %s. Incorrect arguments. Aborting...", inst);
+		}
+		*word = ENCODE_I_TYPE(code->opcode, src1->number, src2->number, (uint32_t) atoi(imm));
+	}
+	return TRUE;
+}
+
+/* 
+ * ================================================================================
+ * This type of instruction need only an immediate field which contains the label
+ * we are jumping to.
+ * ================================================================================
+ */
+static inline int32_t process_j_type_instr(assembler_t* as, char* inst, char* imm, uint32_t* word)
+{
+	const opcode_entry_t *code;
+
+	code = find_opcode(inst, strlen(inst));
+	if (imm == NULL)
+	{
+		return assembler_error(as, "ERROR: Cannot find label %s. Aborting...", "(none)");
+	}
+	symbol_t* addr = symbol_find(as->symbol_table, imm, strlen(imm));
+	if (addr == NULL)
+	{
+		return assembler_error(as, "ERROR: Cannot find label %s. Aborting...", imm);
+	}
+	int32_t offset = addr->address;
+
+	*word = ENCODE_J_TYPE(code->opcode, (uint32_t)(offset / 4));
+	return TRUE;
+}
+/*
+ * ==================================================================================================
+ * Function to process the "la" psuedo instruction. It takes a register and a label as the argument.
+ * It looks up in the register table for the register and looks into the symbol table for the address
+ * of the given label. Then, it creates two instructions: lui and ori, each with the given register as
+ * one of the arguments. For lui we give it bits 16:31 of the offset. For ori, we give it bits 0:15
+ * of the offset. They go in words[0] and words[1].
+ * ===================================================================================================
+ */
+static inline int32_t process_psuedo_instr(assembler_t* as, char* inst, char* r, char* label, uint32_t* words)
+{
+	const opcode_entry_t *code_lui, *code_ori;
+	const register_entry_t *reg;
+
+	code_lui = find_opcode("lui", strlen("lui"));
+	code_ori = find_opcode("ori", strlen("ori"));
+	if (r == NULL || label == NULL)
+	{
+		return assembler_error(as, "ERROR: Incorrect arguments for instruction %s. Aborting...", inst);
+	}
+	reg = find_register(r, strlen(r));
+	if (reg == NULL)
+	{
+		return assembler_error(as, "ERROR: Incorrect arguments for instruction %s. Aborting...", inst);
+	}
+	
+	symbol_t* got = symbol_find(as->symbol_table, label, strlen(label));
+	if (got == NULL)
+	{
+		return assembler_error(as, "ERROR: Cannot find label %s. Aborting...", label);
+	}	
+	uint32_t offset = (uint32_t) got->address;
+
+	// The top 16 bits of the offset go in the lui instruction, the bottom 16 in the ori
+	words[0] = ENCODE_I_TYPE(code_lui->opcode, 0, reg->number, offset >> 16);
+	words[1] = ENCODE_I_TYPE(code_ori->opcode, reg->number, reg->number, offset & 0xffff);
+	return TRUE;
+}
+/*
+ * ==============================================================
+ * Parses a string of len bytes (see asciiz_length) that runs from
+ * str to the closing quote at str_end. Enough zero words for it and
+ * its null terminator are added to the data image and the
+ * characters are packed into them four to a word, the first one in
+ * the low byte. Returns FALSE if we ran out of memory.
+ * ==============================================================
+ */
+static inline int32_t parse_asciiz(assembler_t* as, const char* str, const char* str_end, int32_t len, word_image_t* data)
+{
+	// Stored words, not a run, since the characters go in them
+	uint32_t *words = reserve_words(data, asciiz_words(len));
+
+	if (words == NULL)
+		return assembler_error(as, "ERROR: Unable to allocate memory. Aborting...");
+	pack_asciiz(str, str_end, words);
+	return TRUE;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
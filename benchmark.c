@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "assembler.h"
+
+#define MAX_BENCH_SIZES 16
+#define DEFAULT_REPEAT 3
+// One label for about this many instructions
+#define INSTRS_PER_LABEL 8
+// How many labels away a branch may go, forwards or backwards
+#define BRANCH_REACH 16
+// One .word array and one .asciiz string for this many instructions
+#define INSTRS_PER_DATA 2000
+#define ARRAY_WORDS 1024
+#define STRING_LENGTH 200
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  benchmark.c
+ *
+ * Description: Benchmarks the assembler on synthetic programs. For each size, a
+ * program with that many instructions is generated: every instruction the assembler
+ * encodes, with registers and immediates picked at random, labels every few
+ * instructions that beq and bne reach forwards and backwards and j and jal reach
+ * anywhere, and a data segment of large .word v:N arrays and long .asciiz strings.
+ * The zeroth, first and second pass and the output rendering are then timed on their
+ * own (the best of a few runs) and reported in seconds, source lines per second and
+ * source megabytes per second, so it shows which pass stops scaling as programs grow.
+ *
+ * Invoked as: benchmark [--threads N] [--repeat R] [instructions ...]
+ *         or: benchmark --generate <instructions> <output file>
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+/*
+ * The generated program, grown as it is written.
+ */
+typedef struct
+{
+	char *data;
+	size_t len;
+	size_t capacity;
+} program_t;
+
+/*
+ * How long each stage of one assembly took, in seconds.
+ */
+typedef struct
+{
+	double zeroth;
+	double first;
+	double second;
+	double output;
+} pass_times_t;
+
+int32_t generate_program(int32_t num_instrs, uint32_t seed, program_t* program);
+
+int32_t append(program_t* program, const char* format, ...);
+
+uint32_t next_random(uint32_t* state);
+
+const char* random_register(uint32_t* state);
+
+int32_t time_passes(program_t* program, int32_t threads, pass_times_t* times);
+
+void report(const char* stage, double seconds, int32_t lines, size_t bytes);
+
+int32_t count_lines(program_t* program);
+
+// What the generator picks registers from
+static const char *bench_registers[] =
+{
+	"$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7", "$s0", "$s1", "$s2",
+	"$s3", "$a0", "$a1", "$v0", "$v1", "$zero"
+};
+
+/*
+ * ============================================================================
+ * Main function. Generates and times a program for each size on the command
+ * line (10000, 100000 and 1000000 instructions if there are none), or with
+ * --generate writes one program to a file so it can be fed to the assembler.
+ * ============================================================================
+ */
+int32_t main(int argc, char *argv[])
+{
+	int32_t sizes[MAX_BENCH_SIZES] = { 10000, 100000, 1000000 };
+	int32_t num_sizes = 3;
+	int32_t threads = 1;
+	int32_t repeat = DEFAULT_REPEAT;
+	int32_t i, r;
+	char *program_name = argv[0];
+
+	if (argc == 4 && strcmp(argv[1], "--generate") == 0)
+	{
+		program_t program = { NULL, 0, 0 };
+		FILE *fptr;
+		int32_t ok;
+
+		if (atoi(argv[2]) < 1 || generate_program(atoi(argv[2]), 1, &program) == FALSE)
+		{
+			printf("ERROR: Unable to generate a program of %s instructions. Aborting...\n", argv[2]);
+			free(program.data);
+			return -1;
+		}
+		fptr = fopen(argv[3], "w");
+		ok = (fptr != NULL && fwrite(program.data, 1, program.len, fptr) == program.len);
+		if (fptr != NULL && fclose(fptr) != 0)
+			ok = FALSE;
+		free(program.data);
+		if (ok == FALSE)
+		{
+			printf("ERROR: Unable to write file %s. Aborting...\n", argv[3]);
+			return -1;
+		}
+		return 0;
+	}
+
+	// Options come before the sizes
+	while (argc > 2 && strncmp(argv[1], "--", 2) == 0)
+	{
+		if (strcmp(argv[1], "--threads") == 0)
+			threads = atoi(argv[2]);
+		else if (strcmp(argv[1], "--repeat") == 0)
+			repeat = atoi(argv[2]);
+		else
+			break;
+		argv += 2;
+		argc -= 2;
+	}
+	if (argc > 1)
+	{
+		for (num_sizes = 0; num_sizes + 1 < argc && num_sizes < MAX_BENCH_SIZES; num_sizes++)
+			sizes[num_sizes] = atoi(argv[num_sizes + 1]);
+	}
+	for (i = 0; i < num_sizes && sizes[i] > 0; i++)
+		;
+	if (i < num_sizes || argc > MAX_BENCH_SIZES + 1 || threads < 1 || threads > MAX_ENCODE_THREADS || repeat < 1 ||
+		(argc > 1 && strncmp(argv[1], "--", 2) == 0))
+	{
+		printf("Usage: %s [--threads N] [--repeat R] [instructions ...]\n", program_name);
+		printf("       %s --generate <instructions> <output file>\n", program_name);
+		return -1;
+	}
+
+	printf("%12s %10s %8s  %-8s %10s %14s %10s\n", "Instructions", "Lines", "MB", "Stage", "Seconds", "Lines/s", "MB/s");
+	for (i = 0; i < num_sizes; i++)
+	{
+		program_t program = { NULL, 0, 0 };
+		pass_times_t best, times;
+		int32_t lines;
+
+		if (generate_program(sizes[i], 1, &program) == FALSE)
+		{
+			printf("ERROR: Unable to generate a program of %d instructions. Aborting...\n", sizes[i]);
+			free(program.data);
+			return -1;
+		}
+		lines = count_lines(&program);
+
+		// The best run is the one least disturbed by everything else on the machine
+		for (r = 0; r < repeat; r++)
+		{
+			if (time_passes(&program, threads, &times) == FALSE)
+			{
+				free(program.data);
+				return -1;
+			}
+			if (r == 0 || times.zeroth < best.zeroth)
+				best.zeroth = times.zeroth;
+			if (r == 0 || times.first < best.first)
+				best.first = times.first;
+			if (r == 0 || times.second < best.second)
+				best.second = times.second;
+			if (r == 0 || times.output < best.output)
+				best.output = times.output;
+		}
+
+		printf("%12d %10d %8.2f", sizes[i], lines, program.len / 1048576.0);
+		report("zeroth", best.zeroth, lines, program.len);
+		printf("%32s", "");
+		report("first", best.first, lines, program.len);
+		printf("%32s", "");
+		report("second", best.second, lines, program.len);
+		printf("%32s", "");
+		report("output", best.output, lines, program.len);
+		printf("%32s", "");
+		report("total", best.zeroth + best.first + best.second + best.output, lines, program.len);
+		free(program.data);
+	}
+	return 0;
+}
+
+/*
+ * ============================================================================
+ * Writes a program with num_instrs instructions into program. The same seed
+ * always gives the same program. Returns FALSE if we ran out of memory.
+ * ============================================================================
+ */
+int32_t generate_program(int32_t num_instrs, uint32_t seed, program_t* program)
+{
+	int32_t num_labels = num_instrs / INSTRS_PER_LABEL + 1;
+	int32_t num_data = num_instrs / INSTRS_PER_DATA + 1;
+	int32_t label = 0;
+	int32_t ok = TRUE;
+	int32_t i, j;
+
+	ok = append(program, ".text\nmain:\n");
+	for (i = 0; ok == TRUE && i < num_instrs; i++)
+	{
+		const char *rd = random_register(&seed);
+		const char *rs = random_register(&seed);
+		const char *rt = random_register(&seed);
+		int32_t target;
+
+		if (i % INSTRS_PER_LABEL == 0)
+			ok = append(program, "L%d:\n", label++);
+
+		switch (next_random(&seed) % 20)
+		{
+		case 0: ok = ok && append(program, "\tadd %s, %s, %s\n", rd, rs, rt); break;
+		case 1: ok = ok && append(program, "\tsub %s, %s, %s\n", rd, rs, rt); break;
+		case 2: ok = ok && append(program, "\tor %s, %s, %s\n", rd, rs, rt); break;
+		case 3: ok = ok && append(program, "\tand %s, %s, %s\n", rd, rs, rt); break;
+		case 4: ok = ok && append(program, "\tslt %s, %s, %s    # compare\n", rd, rs, rt); break;
+		case 5: ok = ok && append(program, "\tsll %s, %s, %d\n", rd, rs, (int) (next_random(&seed) % 32)); break;
+		case 6: ok = ok && append(program, "\tsrl %s, %s, %d\n", rd, rs, (int) (next_random(&seed) % 32)); break;
+		case 7: ok = ok && append(program, "\taddi %s, %s, %d\n", rd, rs, (int) (next_random(&seed) % 65536) - 32768); break;
+		case 8: ok = ok && append(program, "\tori %s, %s, %d\n", rd, rs, (int) (next_random(&seed) % 65536)); break;
+		case 9: ok = ok && append(program, "\tandi %s, %s, %d\n", rd, rs, (int) (next_random(&seed) % 65536)); break;
+		case 10: ok = ok && append(program, "\tslti %s, %s, %d\n", rd, rs, (int) (next_random(&seed) % 200) - 100); break;
+		case 11: ok = ok && append(program, "\tlw %s, %d(%s)\n", rd, (int) (next_random(&seed) % 256) * 4, rs); break;
+		case 12: ok = ok && append(program, "\tsw %s, %d($sp)    # spill\n", rd, (int) (next_random(&seed) % 256) * 4); break;
+		case 13:
+		case 14:
+			// Somewhere near this label, behind or ahead of it
+			target = label - 1 + (int32_t) (next_random(&seed) % (2 * BRANCH_REACH + 1)) - BRANCH_REACH;
+			if (target < 0)
+				target = 0;
+			if (target >= num_labels)
+				target = num_labels - 1;
+			ok = ok && append(program, "\t%s %s, %s, L%d\n", (i % 2 == 0) ? "beq" : "bne", rs, rt, target);
+			break;
+		case 15: ok = ok && append(program, "\tj L%d\n", (int) (next_random(&seed) % num_labels)); break;
+		case 16: ok = ok && append(program, "\tjal L%d\n", (int) (next_random(&seed) % num_labels)); break;
+		case 17: ok = ok && append(program, "\tjr $ra\n"); break;
+		case 18: ok = ok && append(program, "\tla %s, arr%d\n", rd, (int) (next_random(&seed) % num_data)); break;
+		default: ok = ok && append(program, "\tla %s, str%d\n", rd, (int) (next_random(&seed) % num_data)); break;
+		}
+	}
+	// Every label a branch or jump can name has to be there
+	while (ok == TRUE && label < num_labels)
+		ok = append(program, "L%d:\n", label++);
+	ok = ok && append(program, "\tjr $ra\n");
+
+	ok = ok && append(program, "\n.data\n");
+	for (i = 0; ok == TRUE && i < num_data; i++)
+	{
+		ok = append(program, "arr%d:\t.word %d:%d\n", i, (int) (next_random(&seed) % 1000), ARRAY_WORDS);
+		ok = ok && append(program, "val%d:\t.word %d\n", i, (int) (next_random(&seed) % 2001) - 1000);
+		ok = ok && append(program, "str%d:\t.asciiz \"", i);
+		for (j = 0; ok == TRUE && j < STRING_LENGTH; j++)
+		{
+			uint32_t c = next_random(&seed) % 32;
+			ok = append(program, "%c", (c < 26) ? 'a' + c : ' ');
+		}
+		ok = ok && append(program, "\"\n");
+	}
+	return ok;
+}
+
+/*
+ * ============================================================================
+ * printf to the end of the program. Returns FALSE if we ran out of memory.
+ * ============================================================================
+ */
+int32_t append(program_t* program, const char* format, ...)
+{
+	va_list args;
+	int len;
+
+	// Nothing the generator writes at once is anywhere near this long
+	if (program->len + MAX_LINE_LENGTH >= program->capacity)
+	{
+		size_t capacity = (program->capacity == 0) ? 65536 : program->capacity * 2;
+		char *data = (char*) realloc(program->data, capacity);
+		if (data == NULL)
+			return FALSE;
+		program->data = data;
+		program->capacity = capacity;
+	}
+
+	va_start(args, format);
+	len = vsnprintf(program->data + program->len, program->capacity - program->len, format, args);
+	va_end(args);
+	if (len < 0)
+		return FALSE;
+	program->len += len;
+	return TRUE;
+}
+
+/*
+ * ============================================================================
+ * A small xorshift generator, so the programs are the same on every machine.
+ * ============================================================================
+ */
+uint32_t next_random(uint32_t* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/*
+ * ============================================================================
+ * Picks a register for an operand.
+ * ============================================================================
+ */
+const char* random_register(uint32_t* state)
+{
+	return bench_registers[next_random(state) % (sizeof(bench_registers) / sizeof(bench_registers[0]))];
+}
+
+/*
+ * ============================================================================
+ * Assembles the program the same way assemble_source does, with the given
+ * number of threads, timing each pass, then times rendering the output in
+ * the default format. Returns FALSE, after printing the error, if the
+ * program did not assemble.
+ * ============================================================================
+ */
+int32_t time_passes(program_t* program, int32_t threads, pass_times_t* times)
+{
+	assembler_options_t options = { FALSE, threads, NULL };
+	output_options_t output_options = { FORMAT_ASCII, TRUE };
+	merged_lines_t merged;
+	struct timespec start;
+	assembler_t as;
+	source_t source;
+	char *buf;
+	size_t size;
+	int32_t ok;
+
+	if (init_assembler(&as, &options) == FALSE)
+	{
+		printf("%s\n", as.error);
+		free_assembler(&as);
+		return FALSE;
+	}
+	source.data = program->data;
+	source.len = program->len;
+	source.mapped = FALSE;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ok = zeroth_pass(&source, as.options.threads, &instr_delims, &merged);
+	if (ok == FALSE)
+		assembler_error(&as, "ERROR: Unable to allocate memory. Aborting...");
+	times->zeroth = seconds_since(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ok = ok && first_pass(&as, &merged);
+	if (ok == TRUE)
+		symbol_freeze(as.symbol_table);
+	times->first = seconds_since(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ok = ok && second_pass(&as, &merged);
+	times->second = seconds_since(&start);
+	free_merged_lines(&merged);
+
+	if (ok == TRUE)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		size = output_size(&output_options, &as.text, &as.data, as.symbol_table);
+		buf = (char*) calloc(1, size);
+		if (buf == NULL)
+			ok = assembler_error(&as, "ERROR: Unable to allocate memory. Aborting...");
+		else
+			render_output(buf, &output_options, &as.text, &as.data, as.symbol_table);
+		free(buf);
+		times->output = seconds_since(&start);
+	}
+
+	if (ok == FALSE)
+		printf("%s\n", as.error);
+	free_assembler(&as);
+	return ok;
+}
+
+/*
+ * ============================================================================
+ * Prints the rest of a row of the report: the stage, how long it took, and
+ * how many lines and megabytes of source that is per second.
+ * ============================================================================
+ */
+void report(const char* stage, double seconds, int32_t lines, size_t bytes)
+{
+	if (seconds <= 0)
+		seconds = 1e-9;
+	printf("  %-8s %10.4f %14.0f %10.1f\n", stage, seconds, lines / seconds, bytes / 1048576.0 / seconds);
+}
+
+/*
+ * ============================================================================
+ * Returns how many lines the program has.
+ * ============================================================================
+ */
+int32_t count_lines(program_t* program)
+{
+	char *cursor = program->data;
+	char *end = program->data + program->len;
+	line_t line;
+	int32_t count = 0;
+
+	while (next_line(&cursor, end, &line) == TRUE)
+		count++;
+	return count;
+}
@@ -0,0 +1,372 @@
+#ifndef __CACHE_H_
+#define __CACHE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "output.h"
+
+#define TRUE 1
+#define FALSE 0
+// A key is 128 bits, written as 32 hex digits
+#define CACHE_KEY_LENGTH 32
+#define MAX_CACHE_PATH 4096
+// Default size bound, in megabytes
+#define DEFAULT_CACHE_SIZE 256
+// Temporary files older than this (in seconds) were left by a run that died
+#define CACHE_STALE_TEMP 3600
+#define CACHE_COPY_CHUNK (1 << 20)
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  cache.h
+ *
+ * Description: An on-disk cache of assembled output files, shared by every run that
+ * points at the same directory. An entry's name is a hash of everything the output
+ * depends on: the source bytes, the assembler version and the output format and byte
+ * order. So an entry never has to be checked or invalidated, a different source or
+ * option just has a different name.
+ *
+ * Entries are written to a temporary file in the cache directory and renamed into
+ * place, so another process sees either the whole entry or none of it, and two
+ * processes storing the same entry just replace one complete file with another. A hit
+ * updates the entry's modification time, and when storing an entry takes the
+ * directory over its size bound, the entries used least recently are deleted first.
+ * A file another process deletes while we are copying it stays readable until we
+ * close it.
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+/*
+ * Where the cache is, and how many bytes of entries it may hold (0 for no bound).
+ */
+typedef struct
+{
+	const char *dir;
+	uint64_t max_bytes;
+} cache_t;
+
+/*
+ * An entry seen while deciding what to evict.
+ */
+typedef struct
+{
+	char name[CACHE_KEY_LENGTH + 1];
+	struct timespec used;
+	uint64_t size;
+} cache_entry_t;
+
+static inline void cache_key(const char* data, size_t len, const char* version, output_options_t* options, char* key);
+
+static inline void cache_hash(const char* data, size_t len, uint64_t* h);
+
+static inline uint64_t cache_rotl(uint64_t x, int r);
+
+static inline uint64_t cache_fmix(uint64_t k);
+
+static inline int cache_open(cache_t* cache, const char* key);
+
+static inline int cache_create(cache_t* cache, char* tmp_path);
+
+static inline int32_t cache_commit(cache_t* cache, char* tmp_path, const char* key);
+
+static inline void cache_evict(cache_t* cache);
+
+static inline int compare_cache_entries(const void* a, const void* b);
+
+static inline int32_t copy_fd(int in, int out);
+
+/*
+ * =====================================================================================
+ * Works out the key for len bytes of source assembled by the given version with the
+ * given output options. The key (CACHE_KEY_LENGTH hex digits and a null) goes in key.
+ * It is the 128 bit hash of the source (see cache_hash), started from the 128 bit hash
+ * of the version and options instead of from zero.
+ * =====================================================================================
+ */
+static inline void cache_key(const char* data, size_t len, const char* version, output_options_t* options, char* key)
+{
+	char settings[256];
+	int settings_len;
+	uint64_t h[2] = { 0, 0 };
+
+	settings_len = snprintf(settings, sizeof(settings), "%s format=%d big_endian=%d",
+		version, (int) options->format, (int) options->big_endian);
+	if (settings_len >= (int) sizeof(settings))
+		settings_len = sizeof(settings) - 1;
+
+	cache_hash(settings, settings_len, h);
+	cache_hash(data, len, h);
+	sprintf(key, "%016llx%016llx", (unsigned long long) h[0], (unsigned long long) h[1]);
+}
+
+/*
+ * =====================================================================================
+ * MurmurHash3 (the x64 128 bit version) of len bytes of data. h holds the two 64 bit
+ * halves to start from, and gets the hash. The bytes are read as little endian
+ * words, so on a little endian machine h = { seed, seed } gives the same hash as the
+ * reference with that seed.
+ * =====================================================================================
+ */
+static inline void cache_hash(const char* data, size_t len, uint64_t* h)
+{
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = h[0], h2 = h[1];
+	uint64_t k1, k2;
+	unsigned char tail[16];
+	size_t i, blocks = len / 16;
+
+	for (i = 0; i < blocks; i++)
+	{
+		memcpy(&k1, data + i * 16, sizeof(k1));
+		memcpy(&k2, data + i * 16 + 8, sizeof(k2));
+
+		k1 *= c1; k1 = cache_rotl(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = cache_rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = cache_rotl(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = cache_rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	// The last 0 to 15 bytes, padded with zeros
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, data + blocks * 16, len & 15);
+	memcpy(&k1, tail, sizeof(k1));
+	memcpy(&k2, tail + 8, sizeof(k2));
+	if ((len & 15) > 8)
+	{
+		k2 *= c2; k2 = cache_rotl(k2, 33); k2 *= c1; h2 ^= k2;
+	}
+	if ((len & 15) > 0)
+	{
+		k1 *= c1; k1 = cache_rotl(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= len; h2 ^= len;
+	h1 += h2; h2 += h1;
+	h1 = cache_fmix(h1); h2 = cache_fmix(h2);
+	h1 += h2; h2 += h1;
+	h[0] = h1;
+	h[1] = h2;
+}
+
+/*
+ * =====================================================================================
+ * Rotates x left by r bits (0 < r < 64).
+ * =====================================================================================
+ */
+static inline uint64_t cache_rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+/*
+ * =====================================================================================
+ * The final mix of cache_hash, which makes every bit of the result depend on every
+ * bit of k.
+ * =====================================================================================
+ */
+static inline uint64_t cache_fmix(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+/*
+ * =====================================================================================
+ * Opens the entry for key for reading and marks it as just used. Returns its file
+ * descriptor, or -1 if it is not in the cache.
+ * =====================================================================================
+ */
+static inline int cache_open(cache_t* cache, const char* key)
+{
+	char path[MAX_CACHE_PATH];
+	int fd;
+
+	if (snprintf(path, sizeof(path), "%s/%s", cache->dir, key) >= (int) sizeof(path))
+		return -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd >= 0)
+	{
+		// The modification time is when it was last used. It doesn't matter if we can't set it.
+		futimens(fd, NULL);
+	}
+	return fd;
+}
+
+/*
+ * =====================================================================================
+ * Creates a temporary file in the cache directory (making the directory if it is not
+ * there) for a new entry to be written to. Its path goes in tmp_path, which has room
+ * for MAX_CACHE_PATH characters. Returns the file descriptor, or -1 if it could not
+ * be created.
+ * =====================================================================================
+ */
+static inline int cache_create(cache_t* cache, char* tmp_path)
+{
+	int fd;
+
+	if (snprintf(tmp_path, MAX_CACHE_PATH, "%s/.tmp-XXXXXX", cache->dir) >= MAX_CACHE_PATH)
+		return -1;
+
+	if (mkdir(cache->dir, 0777) != 0 && errno != EEXIST)
+		return -1;
+
+	fd = mkstemp(tmp_path);
+	if (fd >= 0)
+	{
+		// mkstemp only lets us read it, but the cache can be shared
+		fchmod(fd, 0644);
+	}
+	return fd;
+}
+
+/*
+ * =====================================================================================
+ * Renames the finished temporary file at tmp_path to the entry for key, then evicts
+ * entries if the cache is over its size bound. The temporary file is deleted if it
+ * can't be renamed. Returns FALSE if the entry could not be stored.
+ * =====================================================================================
+ */
+static inline int32_t cache_commit(cache_t* cache, char* tmp_path, const char* key)
+{
+	char path[MAX_CACHE_PATH];
+
+	if (snprintf(path, sizeof(path), "%s/%s", cache->dir, key) >= (int) sizeof(path) ||
+		rename(tmp_path, path) != 0)
+	{
+		unlink(tmp_path);
+		return FALSE;
+	}
+
+	if (cache->max_bytes > 0)
+		cache_evict(cache);
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Deletes the entries used least recently until the ones left fit in the size bound,
+ * along with any temporary files a dead run left behind. Other processes may be
+ * evicting at the same time, so entries that are already gone are not an error.
+ * =====================================================================================
+ */
+static inline void cache_evict(cache_t* cache)
+{
+	char path[MAX_CACHE_PATH];
+	cache_entry_t *entries = NULL;
+	int32_t count = 0, capacity = 0, i;
+	uint64_t total = 0;
+	struct dirent *dirent;
+	struct stat st;
+	DIR *dir;
+
+	dir = opendir(cache->dir);
+	if (dir == NULL)
+		return;
+
+	while ((dirent = readdir(dir)) != NULL)
+	{
+		if (snprintf(path, sizeof(path), "%s/%s", cache->dir, dirent->d_name) >= (int) sizeof(path) ||
+			stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+			continue;
+
+		if (strncmp(dirent->d_name, ".tmp-", 5) == 0)
+		{
+			if (st.st_mtime + CACHE_STALE_TEMP < time(NULL))
+				unlink(path);
+			continue;
+		}
+		if (strlen(dirent->d_name) != CACHE_KEY_LENGTH)
+			continue;
+
+		if (count == capacity)
+		{
+			cache_entry_t *bigger;
+			capacity = (capacity == 0) ? 256 : capacity * 2;
+			bigger = (cache_entry_t*) realloc(entries, sizeof(cache_entry_t) * capacity);
+			if (bigger == NULL)
+				break;
+			entries = bigger;
+		}
+		strcpy(entries[count].name, dirent->d_name);
+		entries[count].used = st.st_mtim;
+		entries[count].size = st.st_size;
+		total += st.st_size;
+		count++;
+	}
+	closedir(dir);
+
+	if (total > cache->max_bytes && count > 0)
+	{
+		qsort(entries, count, sizeof(cache_entry_t), compare_cache_entries);
+		for (i = 0; i < count && total > cache->max_bytes; i++)
+		{
+			snprintf(path, sizeof(path), "%s/%s", cache->dir, entries[i].name);
+			unlink(path);
+			total -= entries[i].size;
+		}
+	}
+	free(entries);
+}
+
+/*
+ * =====================================================================================
+ * qsort comparison that puts the entries used longest ago first.
+ * =====================================================================================
+ */
+static inline int compare_cache_entries(const void* a, const void* b)
+{
+	const struct timespec *used_a = &((const cache_entry_t*) a)->used;
+	const struct timespec *used_b = &((const cache_entry_t*) b)->used;
+
+	if (used_a->tv_sec != used_b->tv_sec)
+		return (used_a->tv_sec < used_b->tv_sec) ? -1 : 1;
+	return (used_a->tv_nsec < used_b->tv_nsec) ? -1 : (used_a->tv_nsec > used_b->tv_nsec) ? 1 : 0;
+}
+
+/*
+ * =====================================================================================
+ * Copies everything left in in to out. Returns FALSE if a read or write failed.
+ * =====================================================================================
+ */
+static inline int32_t copy_fd(int in, int out)
+{
+	char *buf = (char*) malloc(CACHE_COPY_CHUNK);
+	ssize_t got;
+	int32_t ok = (buf != NULL);
+
+	while (ok == TRUE)
+	{
+		got = read(in, buf, CACHE_COPY_CHUNK);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+		{
+			ok = (got == 0);
+			break;
+		}
+		ok = write_all(out, buf, got);
+	}
+	free(buf);
+	return ok;
+}
+
+#endif
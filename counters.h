@@ -0,0 +1,154 @@
+#ifndef __COUNTERS_H_
+#define __COUNTERS_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  counters.h
+ *
+ * Description: Counters for --stats. The tokenizer, the symbol and hash tables, the
+ * source reader and every allocation the assembler makes add to them as they go. They
+ * are per thread, so nothing is shared or locked on the way; a thread that does part
+ * of an assembly for another one (the lexing and encoding threads) measures what it
+ * did with begin_counting and end_counting and the thread that started it adds that
+ * to its own with add_counters once it has joined it.
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+/*
+ * Lookups count the times a table was searched and probes the slots (or chain
+ * entries) looked at, and the longest probe is the most looked at by one search.
+ */
+typedef struct
+{
+	uint64_t lines_read;
+	uint64_t tokens;
+	uint64_t symbol_lookups;
+	uint64_t symbol_probes;
+	uint64_t symbol_longest_probe;
+	uint64_t hash_lookups;
+	uint64_t hash_probes;
+	uint64_t hash_longest_probe;
+	uint64_t allocations;
+	uint64_t bytes_allocated;
+} run_counters_t;
+
+// This thread's counters
+static __thread run_counters_t run_counters;
+
+static inline void begin_counting(run_counters_t* saved);
+
+static inline void end_counting(run_counters_t* saved, run_counters_t* counted);
+
+static inline void add_counters(run_counters_t* counted);
+
+static inline void* counted_malloc(size_t size);
+
+static inline void* counted_calloc(size_t count, size_t size);
+
+static inline void* counted_realloc(void* ptr, size_t size);
+
+static inline char* counted_strdup(const char* str);
+
+/*
+ * =====================================================================================
+ * Starts measuring what this thread does, saving its counters in saved.
+ * =====================================================================================
+ */
+static inline void begin_counting(run_counters_t* saved)
+{
+	*saved = run_counters;
+
+	// The longest probes can't be subtracted later, so they start over
+	run_counters.symbol_longest_probe = 0;
+	run_counters.hash_longest_probe = 0;
+}
+
+/*
+ * =====================================================================================
+ * Stops measuring: counted gets what this thread did since begin_counting saved its
+ * counters in saved, and this thread's counters carry on as if nothing was measured.
+ * =====================================================================================
+ */
+static inline void end_counting(run_counters_t* saved, run_counters_t* counted)
+{
+	counted->lines_read = run_counters.lines_read - saved->lines_read;
+	counted->tokens = run_counters.tokens - saved->tokens;
+	counted->symbol_lookups = run_counters.symbol_lookups - saved->symbol_lookups;
+	counted->symbol_probes = run_counters.symbol_probes - saved->symbol_probes;
+	counted->symbol_longest_probe = run_counters.symbol_longest_probe;
+	counted->hash_lookups = run_counters.hash_lookups - saved->hash_lookups;
+	counted->hash_probes = run_counters.hash_probes - saved->hash_probes;
+	counted->hash_longest_probe = run_counters.hash_longest_probe;
+	counted->allocations = run_counters.allocations - saved->allocations;
+	counted->bytes_allocated = run_counters.bytes_allocated - saved->bytes_allocated;
+
+	if (saved->symbol_longest_probe > run_counters.symbol_longest_probe)
+		run_counters.symbol_longest_probe = saved->symbol_longest_probe;
+	if (saved->hash_longest_probe > run_counters.hash_longest_probe)
+		run_counters.hash_longest_probe = saved->hash_longest_probe;
+}
+
+/*
+ * =====================================================================================
+ * Adds what another thread counted (see end_counting) to this thread's counters.
+ * =====================================================================================
+ */
+static inline void add_counters(run_counters_t* counted)
+{
+	run_counters.lines_read += counted->lines_read;
+	run_counters.tokens += counted->tokens;
+	run_counters.symbol_lookups += counted->symbol_lookups;
+	run_counters.symbol_probes += counted->symbol_probes;
+	if (counted->symbol_longest_probe > run_counters.symbol_longest_probe)
+		run_counters.symbol_longest_probe = counted->symbol_longest_probe;
+	run_counters.hash_lookups += counted->hash_lookups;
+	run_counters.hash_probes += counted->hash_probes;
+	if (counted->hash_longest_probe > run_counters.hash_longest_probe)
+		run_counters.hash_longest_probe = counted->hash_longest_probe;
+	run_counters.allocations += counted->allocations;
+	run_counters.bytes_allocated += counted->bytes_allocated;
+}
+
+/*
+ * =====================================================================================
+ * malloc, calloc, realloc and strdup, counting how many times they are called and how
+ * many bytes they are asked for (a realloc counts the whole new size).
+ * =====================================================================================
+ */
+static inline void* counted_malloc(size_t size)
+{
+	run_counters.allocations++;
+	run_counters.bytes_allocated += size;
+	return malloc(size);
+}
+
+static inline void* counted_calloc(size_t count, size_t size)
+{
+	run_counters.allocations++;
+	run_counters.bytes_allocated += count * size;
+	return calloc(count, size);
+}
+
+static inline void* counted_realloc(void* ptr, size_t size)
+{
+	run_counters.allocations++;
+	run_counters.bytes_allocated += size;
+	return realloc(ptr, size);
+}
+
+static inline char* counted_strdup(const char* str)
+{
+	run_counters.allocations++;
+	run_counters.bytes_allocated += strlen(str) + 1;
+	return strdup(str);
+}
+
+#endif
@@ -18,7 +18,7 @@ typedef  unsigned       char ub1;
 #define hashsize(n) ((ub4)1<<(n))
 #define hashmask(n) (hashsize(n)-1)
 
-static ub4 hash(register ub1 *k, register ub4 length, register ub4 level);
+static ub4 hash(ub1 *k, ub4 length, ub4 level);
 
 /*
 --------------------------------------------------------------------
@@ -74,9 +74,9 @@ acceptable.  Do NOT use for cryptographic purposes.
 --------------------------------------------------------------------
 */
 
-static inline ub4 hash(register ub1 *k, register ub4 length, register ub4 level)
+static inline ub4 hash(ub1 *k, ub4 length, ub4 level)
 {
-   register ub4 a,b,c,d,len;
+   ub4 a,b,c,d,len;
 
    /* Set up the internal state */
    len = length;
@@ -7,6 +7,7 @@
 #include <semaphore.h>
 #include <stdint.h>
 #include "hash_function.h"
+#include "counters.h"
 
 #define TRUE 1
 #define FALSE 0
@@ -52,17 +53,17 @@ static inline hash_table_t *create_hash_table(uint32_t hash_table_size)
   uint32_t t;
   hash_table_t *hash_table;
   
-  hash_table = ( hash_table_t *) malloc(sizeof( hash_table_t));
+  hash_table = ( hash_table_t *) counted_malloc(sizeof( hash_table_t));
   if (hash_table == NULL) return(NULL);
 
-  hash_table->row = ( hash_entry_t **) malloc(sizeof( hash_entry_t *) * (hash_table_size));
+  hash_table->row = ( hash_entry_t **) counted_malloc(sizeof( hash_entry_t *) * (hash_table_size));
   if (hash_table->row == NULL) return(NULL);
   
-  hash_table->tail = ( hash_entry_t **) malloc(sizeof( hash_entry_t *) * (hash_table_size));
+  hash_table->tail = ( hash_entry_t **) counted_malloc(sizeof( hash_entry_t *) * (hash_table_size));
   if (hash_table->tail == NULL) return(NULL);
 
 #ifdef __USE_HASH_LOCKS__
-  hash_table->row_lock = (sem_t *) malloc(sizeof(sem_t) * (hash_table_size + 2));
+  hash_table->row_lock = (sem_t *) counted_malloc(sizeof(sem_t) * (hash_table_size + 2));
   if (hash_table->row_lock == NULL) return(NULL);
 #endif
 
@@ -112,13 +113,13 @@ static inline int32_t hash_insert( hash_table_t *hash_table, void *key, uint32_t
   
   hash_table_size = hash_table->size;
 
-  hash_key  = hash(key, key_len, 7) % hash_table_size;
+  hash_key  = hash((ub1 *) key, key_len, 7) % hash_table_size;
 
 #ifdef __USE_HASH_LOCKS__
   sem_wait(&hash_table->row_lock[hash_key]);
 #endif
   
-  new_entry = ( hash_entry_t *) malloc(sizeof( hash_entry_t));
+  new_entry = ( hash_entry_t *) counted_malloc(sizeof( hash_entry_t));
   if (new_entry == NULL) 
     {
 #ifdef __USE_HASH_LOCKS__
@@ -127,10 +128,9 @@ static inline int32_t hash_insert( hash_table_t *hash_table, void *key, uint32_t
       return(FALSE);
     }
   
-  new_entry->key = (char *) malloc(key_len);
+  new_entry->key = (char *) counted_malloc(key_len);
   if (new_entry->key == NULL)
     {
-      printf("Warning: Unable to allocate memory for hash key. \n");
       free(new_entry);
 #ifdef __USE_HASH_LOCKS__
       sem_post(&hash_table->row_lock[hash_key]);
@@ -176,7 +176,7 @@ static inline int32_t hash_delete( hash_table_t *hash_table, void *key, uint32_t
   
   hash_table_size = hash_table->size;
   
-  hash_key  = hash(key, key_len, 7) % hash_table_size;
+  hash_key  = hash((ub1 *) key, key_len, 7) % hash_table_size;
  
 #ifdef __USE_HASH_LOCKS__
   sem_wait(&(hash_table->row_lock[hash_key]));
@@ -187,7 +187,7 @@ static inline int32_t hash_delete( hash_table_t *hash_table, void *key, uint32_t
 
   while (ptr != NULL)
     {
-      if (memcmp(ptr->key, key, key_len) == 0)
+      if ((key_len == ptr->key_len) && (memcmp(ptr->key, key, key_len) == 0))
 	{
 	  if (prev_ptr == NULL) // First entry
 	    hash_table->row[hash_key] = ptr->next;
@@ -231,21 +231,26 @@ static inline int32_t hash_delete( hash_table_t *hash_table, void *key, uint32_t
 */
 static inline void *hash_find( hash_table_t *hash_table, void *key, uint32_t key_len)
 {
-  uint32_t hash_key, hash_table_size;
+  uint32_t hash_key, hash_table_size, probes = 0;
   hash_entry_t *ptr;
   
 
   hash_table_size = hash_table->size;
 
-  hash_key  = hash(key, key_len, 7) % hash_table_size;
+  hash_key  = hash((ub1 *) key, key_len, 7) % hash_table_size;
 
 #ifdef __USE_HASH_LOCKS__
   sem_wait(&hash_table->row_lock[hash_key]);
 #endif
  
   ptr = hash_table->row[hash_key];
+  run_counters.hash_lookups++;
   while (ptr != NULL)
     {
+      // for --stats, see counters.h. an empty row counts as no probes.
+      run_counters.hash_probes++;
+      if (++probes > run_counters.hash_longest_probe)
+	run_counters.hash_longest_probe = probes;
       if ((key_len == ptr->key_len) && (memcmp(ptr->key, key, key_len) == 0))
 	{
 #ifdef __USE_HASH_LOCKS__
@@ -272,7 +277,7 @@ static inline void *hash_find( hash_table_t *hash_table, void *key, uint32_t key
 
 static inline void destroy_hash_table( hash_table_t *hash_table)
 {
-  uint32_t t, count, max_count=0, tot_count=0, hash_table_size;
+  uint32_t t, hash_table_size;
   hash_entry_t *cur_ptr, *tmp_ptr;
 
   hash_table_size = hash_table->size;
@@ -285,25 +290,20 @@ static inline void destroy_hash_table( hash_table_t *hash_table)
       if (hash_table->row[t] != NULL)
 	{
 	  cur_ptr = hash_table->row[t];
-	  count = 1;
 	  while (cur_ptr != NULL)
 	    {
 	      free(cur_ptr->key);
 	      tmp_ptr = cur_ptr->next;
 	      free(cur_ptr);
 	      cur_ptr = tmp_ptr;
-	      count++;
 	    }
 	  hash_table->row[t] = NULL;
-	  tot_count += count;
-	  if (count > max_count) max_count = count;
 	}
 #ifdef __USE_HASH_LOCKS__
       sem_post(&hash_table->row_lock[t]);
 #endif
     }
 
-  printf("Max collision list entries: %u. Total: %u\n", max_count, tot_count);
   free(hash_table->row);
   free(hash_table->tail);
 
@@ -314,4 +314,268 @@ static inline void destroy_hash_table( hash_table_t *hash_table)
   free(hash_table);
 }
 
+/*
+   symbol table: an open addressing hash table for the labels.
+
+   the entries live in one array in the order they were inserted. index is
+   a power of two sized array of slots, each holding 0 for an empty slot or
+   one past the number of the entry that hashed there, probed linearly. each
+   entry keeps the hash of its key, so a probe only compares keys when the
+   hashes match and growing the index never has to hash a key again. the
+   keys themselves are copied one after another into a single string arena
+   and entries refer to them by offset.
+
+   once the table is frozen nothing can be inserted, and since lookups only
+   read the table, any number of threads can look up symbols at the same
+   time without locks.
+*/
+
+// what a symbol stands for
+#define SYMBOL_TEXT_LABEL 0
+#define SYMBOL_WORD 1
+#define SYMBOL_ASCIIZ 2
+
+// which segment a symbol is in
+#define SECTION_TEXT 0
+#define SECTION_DATA 1
+
+/*
+   what we know about a symbol: its address, the segment it is in, how
+   many bytes it takes up (0 for a text label) and what kind of symbol it is
+*/
+typedef struct
+{
+  int32_t address;
+  int32_t section;
+  int32_t size;
+  int32_t kind;
+} symbol_t;
+
+typedef struct
+{
+  uint32_t hash;
+  uint32_t key_offset;
+  uint32_t key_len;
+  symbol_t symbol;
+} symbol_entry_t;
+
+typedef struct
+{
+  symbol_entry_t *entries;
+  uint32_t *index;
+  char *keys;
+  uint32_t count;
+  uint32_t entries_size;
+  uint32_t index_size;
+  uint32_t keys_len;
+  uint32_t keys_size;
+  int32_t frozen;
+} symbol_table_t;
+
+#define symbol_key(table, entry) ((table)->keys + (entry)->key_offset)
+
+/*
+   creates an empty symbol table
+
+   parameters:
+   initial_size : number of symbols to make room for up front
+
+   returns: pointer to created symbol table or NULL on failure
+*/
+static inline symbol_table_t *create_symbol_table(uint32_t initial_size)
+{
+  symbol_table_t *table;
+
+  table = (symbol_table_t *) counted_calloc(1, sizeof(symbol_table_t));
+  if (table == NULL) return(NULL);
+
+  // keep the index at most half full
+  table->index_size = 16;
+  while (table->index_size < initial_size * 2)
+    table->index_size *= 2;
+  table->entries_size = table->index_size / 2;
+  table->keys_size = table->entries_size * 8;
+
+  table->index = (uint32_t *) counted_calloc(table->index_size, sizeof(uint32_t));
+  table->entries = (symbol_entry_t *) counted_malloc(sizeof(symbol_entry_t) * table->entries_size);
+  table->keys = (char *) counted_malloc(table->keys_size);
+  if (table->index == NULL || table->entries == NULL || table->keys == NULL)
+    {
+      free(table->index);
+      free(table->entries);
+      free(table->keys);
+      free(table);
+      return(NULL);
+    }
+  return(table);
+}
+
+/*
+   finds the entry for key in the symbol table
+
+   parameters:
+   table : symbol table to use
+   key : key to look up, does not have to be null terminated
+   key_len : length of the key in bytes
+
+   returns:
+   pointer to the entry on success
+   NULL if the key is not in the table
+*/
+static inline symbol_entry_t *symbol_find_entry(symbol_table_t *table, const void *key, uint32_t key_len)
+{
+  uint32_t h, mask, slot;
+  symbol_entry_t *entry;
+
+  uint32_t probes = 1;
+  symbol_entry_t *found = NULL;
+
+  h = hash((ub1 *) key, key_len, 7);
+  mask = table->index_size - 1;
+
+  for (slot = h & mask; table->index[slot] != 0; slot = (slot + 1) & mask, probes++)
+    {
+      entry = &table->entries[table->index[slot] - 1];
+      if (entry->hash == h && entry->key_len == key_len &&
+	  memcmp(symbol_key(table, entry), key, key_len) == 0)
+	{
+	  found = entry;
+	  break;
+	}
+    }
+
+  // for --stats, see counters.h
+  run_counters.symbol_lookups++;
+  run_counters.symbol_probes += probes;
+  if (probes > run_counters.symbol_longest_probe)
+    run_counters.symbol_longest_probe = probes;
+  return(found);
+}
+
+/*
+   finds the symbol for key in the symbol table
+
+   returns:
+   pointer to the symbol on success. it stays valid until the next insert.
+   NULL if the key is not in the table
+*/
+static inline symbol_t *symbol_find(symbol_table_t *table, const void *key, uint32_t key_len)
+{
+  symbol_entry_t *entry = symbol_find_entry(table, key, key_len);
+  return((entry == NULL) ? NULL : &entry->symbol);
+}
+
+/*
+   doubles the index and puts every entry back in it, using the cached
+   hashes.
+
+   returns: TRUE on success, FALSE if we ran out of memory
+*/
+static inline int32_t symbol_grow_index(symbol_table_t *table)
+{
+  uint32_t new_size, mask, slot, i;
+  uint32_t *new_index;
+
+  new_size = table->index_size * 2;
+  new_index = (uint32_t *) counted_calloc(new_size, sizeof(uint32_t));
+  if (new_index == NULL) return(FALSE);
+
+  mask = new_size - 1;
+  for (i = 0; i < table->count; i++)
+    {
+      for (slot = table->entries[i].hash & mask; new_index[slot] != 0; slot = (slot + 1) & mask)
+	;
+      new_index[slot] = i + 1;
+    }
+
+  free(table->index);
+  table->index = new_index;
+  table->index_size = new_size;
+  return(TRUE);
+}
+
+/*
+   inserts a symbol into the table. the key is copied into the table's
+   string arena and the symbol into the entry.
+
+   parameters:
+   table : symbol table to use
+   key : key for the symbol, does not have to be null terminated
+   key_len : length of the key in bytes
+   symbol : the symbol to insert
+
+   returns:
+   TRUE if the symbol was inserted
+   FALSE if the key is already in the table, the table is frozen or we
+   ran out of memory
+*/
+static inline int32_t symbol_insert(symbol_table_t *table, const void *key, uint32_t key_len, const symbol_t *symbol)
+{
+  uint32_t h, mask, slot;
+  symbol_entry_t *entry;
+
+  if (table->frozen == TRUE) return(FALSE);
+
+  h = hash((ub1 *) key, key_len, 7);
+  mask = table->index_size - 1;
+  for (slot = h & mask; table->index[slot] != 0; slot = (slot + 1) & mask)
+    {
+      entry = &table->entries[table->index[slot] - 1];
+      if (entry->hash == h && entry->key_len == key_len &&
+	  memcmp(symbol_key(table, entry), key, key_len) == 0)
+	return(FALSE);
+    }
+
+  // make room for the entry and its key
+  if (table->count == table->entries_size)
+    {
+      symbol_entry_t *entries = (symbol_entry_t *) counted_realloc(table->entries, sizeof(symbol_entry_t) * table->entries_size * 2);
+      if (entries == NULL) return(FALSE);
+      table->entries = entries;
+      table->entries_size *= 2;
+    }
+  while (table->keys_len + key_len + 1 > table->keys_size)
+    {
+      char *keys = (char *) counted_realloc(table->keys, table->keys_size * 2);
+      if (keys == NULL) return(FALSE);
+      table->keys = keys;
+      table->keys_size *= 2;
+    }
+
+  entry = &table->entries[table->count];
+  entry->hash = h;
+  entry->key_offset = table->keys_len;
+  entry->key_len = key_len;
+  entry->symbol = *symbol;
+  memcpy(table->keys + table->keys_len, key, key_len);
+  table->keys[table->keys_len + key_len] = '\0';
+  table->keys_len += key_len + 1;
+  table->index[slot] = ++table->count;
+
+  // keep the index at most half full so probes stay short
+  if (table->count * 2 > table->index_size)
+    return(symbol_grow_index(table));
+  return(TRUE);
+}
+
+/*
+   freezes the table. no more symbols can be inserted, and from then on
+   lookups from several threads at once are safe.
+*/
+static inline void symbol_freeze(symbol_table_t *table)
+{
+  table->frozen = TRUE;
+}
+
+/*
+   destroys the symbol table and frees all allocated memory
+*/
+static inline void destroy_symbol_table(symbol_table_t *table)
+{
+  free(table->index);
+  free(table->entries);
+  free(table->keys);
+  free(table);
+}
+
 #endif
@@ -0,0 +1,470 @@
+#ifndef __INCREMENTAL_H_
+#define __INCREMENTAL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "counters.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// First bytes of a state file, followed by the version
+#define LINE_STATE_MAGIC "MIPSINC"
+#define LINE_STATE_VERSION 3
+// Room in a state file for the version of the assembler that wrote it
+#define LINE_STATE_ASSEMBLER_LENGTH 16
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  incremental.h
+ *
+ * Description: State kept between runs for incremental reassembly. Once the first pass
+ * has given every label its address, the words for a line of the text segment only
+ * depend on what the line says and, when it names a label, on the label's address (for
+ * j, jal and la) or on how far the label is from the line (for beq and bne). So for
+ * every text line we remember a hash of its text, that dependency, the name of the
+ * label and the words it was encoded to. On the next run a line whose text and
+ * dependency both match is not tokenized or encoded again, its words are just copied.
+ *
+ * The text itself is not kept. Lines are matched by a line_key_t: the length and two
+ * independent 64 bit hashes of the text, worked out in one pass (see line_key). Two
+ * different lines of the same length would have to collide in both hashes at once to
+ * be taken for each other and get the wrong words.
+ *
+ * The lines are kept in program order, so while the source is the same as last time
+ * each line is compared with the line after the last one found, which is one pass
+ * over its text to hash it and a compare. Only when they stop lining up (a line was
+ * added, removed or changed) are the lines of the last run indexed, and a line is
+ * looked up by its hash and dependency to find where we are again.
+ *
+ * The table is written to a state file next to the output when an assembly succeeds,
+ * and read back at the start of the next one. The state file says which version of
+ * the assembler wrote it, and one from another version is not used, since its words
+ * may not be what this one would encode. A missing or unreadable state file just
+ * means everything gets encoded.
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+/*
+ * What a line's text is matched by. hash also places the line in the indexes.
+ */
+typedef struct
+{
+	uint64_t hash;
+	uint64_t check;
+	uint32_t len;
+} line_key_t;
+
+/*
+ * One text line. dependency is the label's address, or the label's address minus the
+ * line's address when pc_relative is set, and 0 when there is no label. label is the
+ * offset of the label's name in the labels the table was saved with, or -1.
+ */
+typedef struct
+{
+	line_key_t key;
+	int32_t dependency;
+	int32_t label;
+	int32_t pc_relative;
+	int32_t num_words;
+	uint32_t words[2];
+} line_state_t;
+
+/*
+ * The lines in program order and, for a table that was loaded, the label names one
+ * after another, null terminated. next is the line expected to come up next (see
+ * next_line_state). The indexes are only built when they are first needed, and are
+ * open addressing (0 is an empty slot, anything else is one past the number of the
+ * line). index has the first line with each key and dependency, first_index the
+ * first line with each key.
+ */
+typedef struct
+{
+	line_state_t *lines;
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t next;
+	uint32_t *index;
+	uint32_t *first_index;
+	uint32_t index_size;
+	char *labels;
+	uint32_t labels_len;
+} line_state_table_t;
+
+/*
+ * What a state file starts with.
+ */
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	char assembler[LINE_STATE_ASSEMBLER_LENGTH];
+	uint32_t line_size;
+	uint32_t count;
+	uint32_t labels_len;
+} line_state_header_t;
+
+static inline void line_key(const char* start, size_t len, line_key_t* key);
+
+static inline int32_t same_line_key(line_key_t* a, line_key_t* b);
+
+static inline uint64_t hash_mix(uint64_t value);
+
+static inline uint32_t line_slot(uint64_t hash, int32_t dependency);
+
+static inline line_state_t* next_line_state(line_state_table_t* table, line_key_t* key);
+
+static inline line_state_t* match_line_state(line_state_table_t* table, line_key_t* key, int32_t dependency);
+
+static inline int32_t index_line_states(line_state_table_t* table);
+
+static inline int32_t reserve_line_states(line_state_table_t* table, uint32_t count);
+
+static inline int32_t add_line_state(line_state_table_t* table, line_state_t* line);
+
+static inline int32_t load_line_states(const char* path, const char* assembler, line_state_table_t* table);
+
+static inline int32_t save_line_states(const char* path, const char* assembler, line_state_table_t* table, const char* labels, uint32_t labels_len);
+
+static inline void free_line_states(line_state_table_t* table);
+
+/*
+ * =====================================================================================
+ * Works out the key of a line of source. The line is read once, eight bytes at a time,
+ * with the last few bytes padded with zeros. Every block goes into two hashes that
+ * don't share anything: hash mixes the block first (see hash_mix), check takes it
+ * through a round of xxHash64. A line is only reused when the length and both hashes
+ * match, so a collision in one of them alone can't give a line the wrong words.
+ * =====================================================================================
+ */
+static inline void line_key(const char* start, size_t len, line_key_t* key)
+{
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+	uint64_t c = 0x27d4eb2f165667c5ULL + len;
+	uint64_t block;
+
+	key->len = (uint32_t) len;
+	while (len >= 8)
+	{
+		memcpy(&block, start, 8);
+		h = (h ^ hash_mix(block)) * 0x9fb21c651e98df25ULL;
+		c += block * 0xc2b2ae3d27d4eb4fULL;
+		c = ((c << 31) | (c >> 33)) * 0x9e3779b185ebca87ULL;
+		start += 8;
+		len -= 8;
+	}
+	if (len > 0)
+	{
+		block = 0;
+		memcpy(&block, start, len);
+		h = (h ^ hash_mix(block)) * 0x9fb21c651e98df25ULL;
+		c += block * 0xc2b2ae3d27d4eb4fULL;
+		c = ((c << 31) | (c >> 33)) * 0x9e3779b185ebca87ULL;
+	}
+	key->hash = hash_mix(h);
+	key->check = hash_mix(c);
+}
+
+/*
+ * =====================================================================================
+ * Returns TRUE if the two keys are the same, which we take to mean the same text.
+ * =====================================================================================
+ */
+static inline int32_t same_line_key(line_key_t* a, line_key_t* b)
+{
+	return (a->hash == b->hash && a->check == b->check && a->len == b->len) ? TRUE : FALSE;
+}
+
+/*
+ * =====================================================================================
+ * Scrambles the bits of value so each one affects all of the result (the finalizer of
+ * MurmurHash3).
+ * =====================================================================================
+ */
+static inline uint64_t hash_mix(uint64_t value)
+{
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdULL;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ULL;
+	value ^= value >> 33;
+	return value;
+}
+
+/*
+ * =====================================================================================
+ * Returns where a line with the given hash and dependency starts probing in index,
+ * before it is masked. first_index uses the low bits of the hash instead.
+ * =====================================================================================
+ */
+static inline uint32_t line_slot(uint64_t hash, int32_t dependency)
+{
+	return (uint32_t)(hash >> 32) ^ ((uint32_t) dependency * 0x9e3779b9U);
+}
+
+/*
+ * =====================================================================================
+ * Finds a line with the given key, which has the same text and so the same label and
+ * size, for the next line of this assembly. That is the expected line if it has the
+ * key, otherwise the first line with the key, and the line after the one found is
+ * expected next. Returns NULL if there is none, or if the lines could not be indexed.
+ * =====================================================================================
+ */
+static inline line_state_t* next_line_state(line_state_table_t* table, line_key_t* key)
+{
+	uint32_t mask, slot;
+
+	if (table->next < table->count && same_line_key(&table->lines[table->next].key, key) == TRUE)
+		return &table->lines[table->next++];
+
+	if (table->count == 0 || index_line_states(table) == FALSE)
+		return NULL;
+
+	mask = table->index_size - 1;
+	for (slot = (uint32_t) key->hash & mask; table->first_index[slot] != 0; slot = (slot + 1) & mask)
+	{
+		if (same_line_key(&table->lines[table->first_index[slot] - 1].key, key) == TRUE)
+		{
+			table->next = table->first_index[slot];
+			return &table->lines[table->first_index[slot] - 1];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * =====================================================================================
+ * Finds a line with the given key and dependency, and expects the one after it next.
+ * Returns NULL if there is none, or if the lines could not be indexed.
+ * =====================================================================================
+ */
+static inline line_state_t* match_line_state(line_state_table_t* table, line_key_t* key, int32_t dependency)
+{
+	uint32_t mask, slot;
+	line_state_t *line;
+
+	if (table->count == 0 || index_line_states(table) == FALSE)
+		return NULL;
+
+	mask = table->index_size - 1;
+	for (slot = line_slot(key->hash, dependency) & mask; table->index[slot] != 0; slot = (slot + 1) & mask)
+	{
+		line = &table->lines[table->index[slot] - 1];
+		if (same_line_key(&line->key, key) == TRUE && line->dependency == dependency)
+		{
+			table->next = table->index[slot];
+			return line;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * =====================================================================================
+ * Builds the indexes, the first time it is called. They are kept at most half full so
+ * probes stay short, and only the first of the lines that are the same goes in, since
+ * a program repeats some lines (nop, a jump to the same label) a lot. Returns FALSE if
+ * we ran out of memory.
+ * =====================================================================================
+ */
+static inline int32_t index_line_states(line_state_table_t* table)
+{
+	uint32_t size = 2048;
+	uint32_t mask, slot, i;
+	line_state_t *line, *other;
+
+	if (table->index_size != 0)
+		return TRUE;
+
+	while (size < table->count * 2)
+		size *= 2;
+	table->index = (uint32_t*) counted_calloc(size, sizeof(uint32_t));
+	table->first_index = (uint32_t*) counted_calloc(size, sizeof(uint32_t));
+	if (table->index == NULL || table->first_index == NULL)
+	{
+		free(table->index);
+		free(table->first_index);
+		table->index = table->first_index = NULL;
+		return FALSE;
+	}
+	table->index_size = size;
+	mask = size - 1;
+
+	for (i = 0; i < table->count; i++)
+	{
+		line = &table->lines[i];
+		for (slot = line_slot(line->key.hash, line->dependency) & mask; table->index[slot] != 0; slot = (slot + 1) & mask)
+		{
+			other = &table->lines[table->index[slot] - 1];
+			if (same_line_key(&other->key, &line->key) == TRUE && other->dependency == line->dependency)
+				break;
+		}
+		if (table->index[slot] != 0)
+			continue;
+		table->index[slot] = i + 1;
+
+		for (slot = (uint32_t) line->key.hash & mask; table->first_index[slot] != 0; slot = (slot + 1) & mask)
+		{
+			if (same_line_key(&table->lines[table->first_index[slot] - 1].key, &line->key) == TRUE)
+				break;
+		}
+		if (table->first_index[slot] == 0)
+			table->first_index[slot] = i + 1;
+	}
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Makes room for count lines, so adding that many does not have to grow the table.
+ * Returns FALSE if we ran out of memory.
+ * =====================================================================================
+ */
+static inline int32_t reserve_line_states(line_state_table_t* table, uint32_t count)
+{
+	line_state_t *lines;
+
+	if (count <= table->capacity)
+		return TRUE;
+	lines = (line_state_t*) counted_realloc(table->lines, sizeof(line_state_t) * count);
+	if (lines == NULL)
+		return FALSE;
+	table->lines = lines;
+	table->capacity = count;
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Adds a copy of line after the others. Returns FALSE if we ran out of memory.
+ * =====================================================================================
+ */
+static inline int32_t add_line_state(line_state_table_t* table, line_state_t* line)
+{
+	if (table->count == table->capacity &&
+		reserve_line_states(table, (table->capacity == 0) ? 1024 : table->capacity * 2) == FALSE)
+		return FALSE;
+
+	table->lines[table->count++] = *line;
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Reads the state file at path into an empty table. assembler is the version of the
+ * assembler, which has to be the one that wrote it. Returns FALSE, and leaves the
+ * table empty, if there is no state file or it is not one we can use.
+ * =====================================================================================
+ */
+static inline int32_t load_line_states(const char* path, const char* assembler, line_state_table_t* table)
+{
+	line_state_header_t header;
+	line_state_t *lines = NULL;
+	char *labels = NULL;
+	int32_t ok = FALSE;
+	uint32_t i;
+	FILE *fptr;
+
+	memset(table, 0, sizeof(line_state_table_t));
+	fptr = fopen(path, "rb");
+	if (fptr == NULL)
+		return FALSE;
+
+	if (fread(&header, sizeof(header), 1, fptr) == 1 &&
+		memcmp(header.magic, LINE_STATE_MAGIC, sizeof(LINE_STATE_MAGIC)) == 0 &&
+		header.version == LINE_STATE_VERSION && header.line_size == sizeof(line_state_t) &&
+		strncmp(header.assembler, assembler, sizeof(header.assembler)) == 0)
+	{
+		lines = (line_state_t*) counted_malloc(sizeof(line_state_t) * (header.count + 1));
+		labels = (char*) counted_malloc(header.labels_len + 1);
+		ok = (lines != NULL && labels != NULL &&
+			fread(lines, sizeof(line_state_t), header.count, fptr) == header.count &&
+			fread(labels, 1, header.labels_len, fptr) == header.labels_len);
+	}
+	fclose(fptr);
+
+	// Check that every label name is inside the labels and null terminated
+	for (i = 0; ok == TRUE && i < header.count; i++)
+	{
+		if (lines[i].label >= 0 && ((uint32_t) lines[i].label >= header.labels_len ||
+			memchr(labels + lines[i].label, '\0', header.labels_len - lines[i].label) == NULL))
+			ok = FALSE;
+		if (lines[i].num_words < 1 || lines[i].num_words > 2)
+			ok = FALSE;
+	}
+
+	if (ok == TRUE)
+	{
+		table->lines = lines;
+		table->count = table->capacity = header.count;
+		table->labels = labels;
+		table->labels_len = header.labels_len;
+		return TRUE;
+	}
+	free(lines);
+	free(labels);
+	return FALSE;
+}
+
+/*
+ * =====================================================================================
+ * Writes the table to the state file at path, marked as written by the given version
+ * of the assembler. labels holds the names the labels of the lines are offsets into.
+ * It is written to a temporary file first and renamed over path, so a reader never
+ * sees half a state file. Returns FALSE if the state file could not be written.
+ * =====================================================================================
+ */
+static inline int32_t save_line_states(const char* path, const char* assembler, line_state_table_t* table, const char* labels, uint32_t labels_len)
+{
+	line_state_header_t header;
+	char tmp_path[4096];
+	int32_t ok;
+	FILE *fptr;
+
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int) sizeof(tmp_path))
+		return FALSE;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LINE_STATE_MAGIC, sizeof(LINE_STATE_MAGIC));
+	header.version = LINE_STATE_VERSION;
+	strncpy(header.assembler, assembler, sizeof(header.assembler) - 1);
+	header.line_size = sizeof(line_state_t);
+	header.count = table->count;
+	header.labels_len = labels_len;
+
+	fptr = fopen(tmp_path, "wb");
+	if (fptr == NULL)
+		return FALSE;
+	ok = (fwrite(&header, sizeof(header), 1, fptr) == 1 &&
+		fwrite(table->lines, sizeof(line_state_t), table->count, fptr) == table->count &&
+		fwrite(labels, 1, labels_len, fptr) == labels_len);
+	if (fclose(fptr) != 0)
+		ok = FALSE;
+	if (ok == TRUE && rename(tmp_path, path) == 0)
+		return TRUE;
+	remove(tmp_path);
+	return FALSE;
+}
+
+/*
+ * =====================================================================================
+ * Frees the table and leaves it empty.
+ * =====================================================================================
+ */
+static inline void free_line_states(line_state_table_t* table)
+{
+	free(table->lines);
+	free(table->index);
+	free(table->first_index);
+	free(table->labels);
+	memset(table, 0, sizeof(line_state_table_t));
+}
+
+#endif
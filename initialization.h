@@ -1,191 +1,233 @@
-#include "hash_table.h"
-#include <string.h>
+#ifndef __INITIALIZATION_H_
+#define __INITIALIZATION_H_
 
-#define lw "100011"
-#define sw "101011"
-#define add "100000"
-#define sub "100010"
-#define addi "001000"
-#define or "100101"
-#define and "100100"
-#define ori "001101"
-#define andi "001100"
-#define slt "101010"
-#define slti "001010"
-#define sll "000000"
-#define srl "000010"
-#define beq "000100"
-#define bne "000101"
-#define j "000010"
-#define jr "000000000000000001000"
-#define jal "000011"
-#define lui "001111"
-#define $v0 "00010"
-#define $v1 "00011"	
-#define $a0 "00100"	
-#define $a1 "00101"
-#define $a2 "00110"
-#define $a3 "00111"
-#define $t0 "01000"
-#define $t1 "01001"
-#define $t2 "01010"
-#define $t3 "01011"
-#define $t4 "01100"
-#define $t5 "01101"
-#define $t6 "01110"
-#define $t7 "01111"	
-#define $s0 "10000"
-#define $s1 "10001"
-#define $s2 "10010"
-#define $s3 "10011"
-#define $s4 "10100"
-#define $s5 "10101"
-#define $s6 "10110"
-#define $s7 "10111"
-#define $t8 "11000"
-#define $t9 "11001"
-#define $gp "11100"
-#define $sp "11101"
-#define $fp "11110"
-#define $ra "11111"
-#define $k0 "11010"
-#define $k1 "11011"
-#define $at "00001"
-#define $zero "00000"
-#define la "-1"
+#include <string.h>
+#include <stdint.h>
 
 /*
  * =====================================================================================
  *
  * Filename:  initialization.h
  *
- * Description: Initializes our two hash tables with data. The first hash table will 
- * contain the opcodes for all the instructions (in binary form). The other hash table
- * will contain all the binary identifiers for the registers.
+ * Description: Lookup tables for the instructions and registers. The first table
+ * contains the opcodes for all the instructions (as numbers, along with the function
+ * field for the r-type ones). The other table contains the number of each register.
+ * Both are constant arrays, and names are found with a switch on the length and the
+ * characters of the name, so there is nothing to build at startup or free at the end,
+ * and a lookup is at most one string compare.
  *
  * Author:  Karthik Kumar, kkumar91@vt.edu
  *
  * =====================================================================================
  */
 
-void init_opcodes_table(hash_table_t *code_table);
+/*
+ * What we need to know to encode an instruction: the opcode (bits 31:26) and, for the
+ * r-type instructions that all have opcode 0, the function field (bits 5:0).
+ */
+typedef struct
+{
+	const char *name;
+	uint32_t opcode;
+	uint32_t funct;
+} opcode_entry_t;
+
+/*
+ * A register name and its number (what goes in the rs, rt or rd field).
+ */
+typedef struct
+{
+	const char *name;
+	uint32_t number;
+} register_entry_t;
 
-void init_register_table(hash_table_t *register_table);
+// Where each instruction is in opcode_entries
+enum
+{
+	OP_LW, OP_SW, OP_ADD, OP_SUB, OP_ADDI, OP_OR, OP_AND, OP_ORI, OP_ANDI, OP_SLT,
+	OP_SLTI, OP_SLL, OP_SRL, OP_BEQ, OP_J, OP_JR, OP_JAL, OP_LUI, OP_BNE, OP_LA
+};
+
+static const opcode_entry_t opcode_entries[] =
+{
+	[OP_LW]   = { "lw",   0x23, 0x00 },		// 100011
+	[OP_SW]   = { "sw",   0x2b, 0x00 },		// 101011
+	[OP_ADD]  = { "add",  0x00, 0x20 },		// funct 100000
+	[OP_SUB]  = { "sub",  0x00, 0x22 },		// funct 100010
+	[OP_ADDI] = { "addi", 0x08, 0x00 },		// 001000
+	[OP_OR]   = { "or",   0x00, 0x25 },		// funct 100101
+	[OP_AND]  = { "and",  0x00, 0x24 },		// funct 100100
+	[OP_ORI]  = { "ori",  0x0d, 0x00 },		// 001101
+	[OP_ANDI] = { "andi", 0x0c, 0x00 },		// 001100
+	[OP_SLT]  = { "slt",  0x00, 0x2a },		// funct 101010
+	[OP_SLTI] = { "slti", 0x0a, 0x00 },		// 001010
+	[OP_SLL]  = { "sll",  0x00, 0x00 },		// funct 000000
+	[OP_SRL]  = { "srl",  0x00, 0x02 },		// funct 000010
+	[OP_BEQ]  = { "beq",  0x04, 0x00 },		// 000100
+	[OP_J]    = { "j",    0x02, 0x00 },		// 000010
+	[OP_JR]   = { "jr",   0x00, 0x08 },		// funct 001000
+	[OP_JAL]  = { "jal",  0x03, 0x00 },		// 000011
+	[OP_LUI]  = { "lui",  0x0f, 0x00 },		// 001111
+	[OP_BNE]  = { "bne",  0x05, 0x00 },		// 000101
+	[OP_LA]   = { "la",   0x00, 0x00 }		// psuedo instruction, turns into lui and ori
+};
+
+// Indexed by register number
+static const register_entry_t register_entries[] =
+{
+	{ "$zero", 0 },
+	{ "$at", 1 },
+	{ "$v0", 2 },
+	{ "$v1", 3 },
+	{ "$a0", 4 },
+	{ "$a1", 5 },
+	{ "$a2", 6 },
+	{ "$a3", 7 },
+	{ "$t0", 8 },
+	{ "$t1", 9 },
+	{ "$t2", 10 },
+	{ "$t3", 11 },
+	{ "$t4", 12 },
+	{ "$t5", 13 },
+	{ "$t6", 14 },
+	{ "$t7", 15 },
+	{ "$s0", 16 },
+	{ "$s1", 17 },
+	{ "$s2", 18 },
+	{ "$s3", 19 },
+	{ "$s4", 20 },
+	{ "$s5", 21 },
+	{ "$s6", 22 },
+	{ "$s7", 23 },
+	{ "$t8", 24 },
+	{ "$t9", 25 },
+	{ "$k0", 26 },
+	{ "$k1", 27 },
+	{ "$gp", 28 },
+	{ "$sp", 29 },
+	{ "$fp", 30 },
+	{ "$ra", 31 }
+};
+
+static inline const opcode_entry_t* find_opcode(const char* name, uint32_t len);
+
+static inline const register_entry_t* find_register(const char* name, uint32_t len);
+
+static inline const opcode_entry_t* opcode_if_equal(const char* name, uint32_t len, int32_t op);
 
 /*
- * Initializes our hash table with the opcodes. It simply calls the hash_insert method
- * for each intruction
+ * Finds the instruction name (len characters, not null terminated) in the opcode table.
+ * The length and the first one or two characters narrow it down to a single candidate,
+ * which is then compared with the whole name. Returns NULL if it is not an instruction.
  */
-void init_opcodes_table(hash_table_t *code_table) 
+static inline const opcode_entry_t* find_opcode(const char* name, uint32_t len)
 {
-	hash_insert(code_table, "lw", strlen("lw"), lw); 
-	
-	hash_insert(code_table, "sw", strlen("sw"), sw);
-
-	hash_insert(code_table, "add", strlen("add"), add);
-	
-	hash_insert(code_table, "sub", strlen("sub"), sub);
-
-	hash_insert(code_table, "addi", strlen("addi"), addi);
-
-	hash_insert(code_table, "or", strlen("or"), or);
-	
-	hash_insert(code_table, "and", strlen("and"), and);
-	
-	hash_insert(code_table, "ori", strlen("ori"), ori);
-	
-	hash_insert(code_table, "andi", strlen("andi"), andi);
-	
-	hash_insert(code_table, "slt", strlen("slt"), slt);
-	
-	hash_insert(code_table, "slti", strlen("slti"), slti);
-	
-	hash_insert(code_table, "sll", strlen("sll"), sll);
-	
-	hash_insert(code_table, "srl", strlen("srl"), srl);
-	
-	hash_insert(code_table, "beq", strlen("beq"), beq);
-	
-	hash_insert(code_table, "j", strlen("j"), j);
-	
-	hash_insert(code_table, "jr", strlen("jr"), jr);
-	
-	hash_insert(code_table, "jal", strlen("jal"), jal);
-
-	hash_insert(code_table, "lui", strlen("lui"), lui);
-	
-	hash_insert(code_table, "bne", strlen("bne"), bne);
-
-	hash_insert(code_table, "la", strlen("la"), bne);
+	switch (len)
+	{
+	case 1:
+		return opcode_if_equal(name, len, OP_J);
+	case 2:
+		switch (name[0])
+		{
+		case 'l': return opcode_if_equal(name, len, (name[1] == 'w') ? OP_LW : OP_LA);
+		case 's': return opcode_if_equal(name, len, OP_SW);
+		case 'o': return opcode_if_equal(name, len, OP_OR);
+		case 'j': return opcode_if_equal(name, len, OP_JR);
+		}
+		break;
+	case 3:
+		switch (name[0])
+		{
+		case 'a': return opcode_if_equal(name, len, (name[1] == 'd') ? OP_ADD : OP_AND);
+		case 'o': return opcode_if_equal(name, len, OP_ORI);
+		case 'b': return opcode_if_equal(name, len, (name[1] == 'e') ? OP_BEQ : OP_BNE);
+		case 'j': return opcode_if_equal(name, len, OP_JAL);
+		case 'l': return opcode_if_equal(name, len, OP_LUI);
+		case 's':
+			if (name[1] == 'u')
+				return opcode_if_equal(name, len, OP_SUB);
+			if (name[1] == 'r')
+				return opcode_if_equal(name, len, OP_SRL);
+			return opcode_if_equal(name, len, (name[2] == 't') ? OP_SLT : OP_SLL);
+		}
+		break;
+	case 4:
+		switch (name[0])
+		{
+		case 'a': return opcode_if_equal(name, len, (name[1] == 'd') ? OP_ADDI : OP_ANDI);
+		case 's': return opcode_if_equal(name, len, OP_SLTI);
+		}
+		break;
+	}
+	return NULL;
 }
 
 /*
- * Initializes the register table. Calls the hash_insert method
- * several times.
+ * Returns the entry for op if its name is exactly name, NULL if not. The caller has
+ * already checked that the lengths match.
  */
-void init_register_table(hash_table_t *register_table) 
+static inline const opcode_entry_t* opcode_if_equal(const char* name, uint32_t len, int32_t op)
 {
-	hash_insert(register_table, "$v0", strlen("$v0"), $v0);
-	
-	hash_insert(register_table, "$v1", strlen("$v1"), $v1);
-	
-	hash_insert(register_table, "$a0", strlen("$a0"), $a0);
-	
-	hash_insert(register_table, "$a1", strlen("$a1"), $a1);
-	
-	hash_insert(register_table, "$a2", strlen("$a2"), $a2);
-	
-	hash_insert(register_table, "$a3", strlen("$a3"), $a3);
-	
-	hash_insert(register_table, "$t0", strlen("$t0"), $t0);
-	
-	hash_insert(register_table, "$t1", strlen("$t1"), $t1);
-	
-	hash_insert(register_table, "$t2", strlen("$t2"), $t2);
-	
-	hash_insert(register_table, "$t3", strlen("$t3"), $t3);
-	
-	hash_insert(register_table, "$t4", strlen("$t4"), $t4);
-
-	hash_insert(register_table, "$t5", strlen("$t5"), $t5);
-	
-	hash_insert(register_table, "$t6", strlen("$t6"), $t6);
-	
-	hash_insert(register_table, "$t7", strlen("$t7"), $t7);
-	
-	hash_insert(register_table, "$t8", strlen("$t8"), $t8);
-	
-	hash_insert(register_table, "$t9", strlen("$t9"), $t9);
-	
-	hash_insert(register_table, "$s0", strlen("$s0"), $s0);
-	
-	hash_insert(register_table, "$s1", strlen("$s1"), $s1);
-	
-	hash_insert(register_table, "$s2", strlen("$s2"), $s2);
-	
-	hash_insert(register_table, "$s3", strlen("$s3"), $s3);
-	
-	hash_insert(register_table, "$s4", strlen("$s4"), $s4);
-	
-	hash_insert(register_table, "$s5", strlen("$s5"), $s5);
-	
-	hash_insert(register_table, "$s6", strlen("$s6"), $s6);
-	
-	hash_insert(register_table, "$s7", strlen("$s7"), $s7);
-
-	hash_insert(register_table, "$gp", strlen("$gp"), $gp);
-	
-	hash_insert(register_table, "$sp", strlen("$sp"), $sp);
-	
-	hash_insert(register_table, "$fp", strlen("$fp"), $fp);
-
-	hash_insert(register_table, "$ra", strlen("$ra"), $ra);
-
-	hash_insert(register_table, "$k0", strlen("$k0"), $k0);
-	
-	hash_insert(register_table, "$k1", strlen("$k1"), $k1);
-
-	hash_insert(register_table, "$at", strlen("$at"), $at);
-
-	hash_insert(register_table, "$zero", strlen("$zero"), $zero);
+	return (memcmp(name, opcode_entries[op].name, len) == 0) ? &opcode_entries[op] : NULL;
 }
+
+/*
+ * Finds the register name (len characters, not null terminated) in the register table.
+ * The number is worked out from the letter and digit after the '$'. Returns NULL if it
+ * is not a register.
+ */
+static inline const register_entry_t* find_register(const char* name, uint32_t len)
+{
+	int32_t digit;
+
+	if (len == 5 && memcmp(name, "$zero", 5) == 0)
+		return &register_entries[0];
+	if (len != 3 || name[0] != '$')
+		return NULL;
+
+	digit = name[2] - '0';
+	switch (name[1])
+	{
+	case 'v':
+		if (digit >= 0 && digit <= 1)
+			return &register_entries[2 + digit];
+		break;
+	case 'a':
+		if (digit >= 0 && digit <= 3)
+			return &register_entries[4 + digit];
+		if (name[2] == 't')
+			return &register_entries[1];
+		break;
+	case 't':
+		if (digit >= 0 && digit <= 7)
+			return &register_entries[8 + digit];
+		if (digit >= 8 && digit <= 9)
+			return &register_entries[24 + digit - 8];
+		break;
+	case 's':
+		if (digit >= 0 && digit <= 7)
+			return &register_entries[16 + digit];
+		if (name[2] == 'p')
+			return &register_entries[29];
+		break;
+	case 'k':
+		if (digit >= 0 && digit <= 1)
+			return &register_entries[26 + digit];
+		break;
+	case 'g':
+		if (name[2] == 'p')
+			return &register_entries[28];
+		break;
+	case 'f':
+		if (name[2] == 'p')
+			return &register_entries[30];
+		break;
+	case 'r':
+		if (name[2] == 'a')
+			return &register_entries[31];
+		break;
+	}
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,922 @@
+#ifndef __OUTPUT_H_
+#define __OUTPUT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <elf.h>
+
+#include "hash_table.h"
+#include "utilities.h"
+#include "counters.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// Output formats
+#define FORMAT_ASCII 0
+#define FORMAT_BIN 1
+#define FORMAT_ELF 2
+
+// First word of a --format=bin file. Reads as "MIPS" when the file is big endian
+// and "SPIM" when it is little endian.
+#define BIN_MAGIC 0x4d495053
+// Second word of a --format=bin file. Version 1 had no run records.
+#define BIN_VERSION 2
+#define BIN_HEADER_SIZE 32
+#define BIN_RUN_SIZE 12
+
+#define ELF_NUM_PHDRS 2
+#define ELF_NUM_SECTIONS 7
+#define ELF_SHSTRTAB "\0.text\0.data\0.bss\0.symtab\0.strtab\0.shstrtab"
+// Section header indexes
+#define ELF_TEXT_SECTION 1
+#define ELF_DATA_SECTION 2
+#define ELF_BSS_SECTION 3
+
+// Most bytes handed to one write() when the output can't be mapped
+#define OUTPUT_WRITE_CHUNK (1 << 20)
+
+// Fewest repeats of a word that add_words keeps as a run instead of storing them
+#define WORD_RUN_MIN 64
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  output.h
+ *
+ * Description: Output layer for the assembler. The passes put the encoded words of the
+ * text and data segments into two word images, and once the whole program has been
+ * assembled they are written out in one of three formats:
+ *
+ *   ascii - every word as a line of 32 '0'/'1' characters, with a blank line between
+ *           the text and the data segment
+ *   bin   - a header (magic, version, then the address, size in bytes and number of
+ *           runs of the text and of the data segment) and then for each segment its
+ *           run records (first word, number of words, the word) and the words that
+ *           aren't in a run, all as 32 bit words in the chosen byte order
+ *   elf   - an ELF32 MIPS executable with .text and .data sections at the segment
+ *           addresses and a symbol table with every label, all local except main,
+ *           which is global and the entry point. The zeros at the end of the data
+ *           segment are a .bss section, so they take no room in the file. The text
+ *           segment has to end before the data segment starts (elf_segments_fit).
+ *
+ * A big .word array is kept in the image as a run (the word and how many times it
+ * repeats) rather than as that many words, so .word 7:10000000 takes a few bytes until
+ * it is rendered. The ascii and elf formats copy a run's word out in doubling chunks
+ * (see fill_repeated), bin writes it as a run record, and the trailing zeros that elf
+ * leaves to .bss are found without looking at every word.
+ *
+ * The size of the output is known exactly before anything is written, so a regular
+ * output file has that much disk space allocated (posix_fallocate), is mapped and is
+ * rendered in place. Anything else (a pipe, a file that can't be mapped, or a disk
+ * without room for the allocation) gets the output rendered into one buffer that goes
+ * out with a few large write() calls, so running out of space is an error rather than
+ * a SIGBUS.
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+/*
+ * count copies of word, starting start words into the image. at is how many of the
+ * stored words come before it.
+ */
+typedef struct
+{
+	uint32_t word;
+	int32_t start;
+	int32_t count;
+	int32_t at;
+} word_run_t;
+
+/*
+ * The words of a segment. count is every word in it, runs included, and words holds
+ * the stored words that aren't in a run, in order. Use image_word to read a word.
+ */
+typedef struct
+{
+	uint32_t address;
+	uint32_t *words;
+	int32_t count;
+	int32_t stored;
+	int32_t capacity;
+	word_run_t *runs;
+	int32_t num_runs;
+	int32_t runs_capacity;
+} word_image_t;
+
+typedef struct
+{
+	int32_t format;
+	int32_t big_endian;
+} output_options_t;
+
+/*
+ * Where everything goes in an elf file, and how big it is.
+ */
+typedef struct
+{
+	uint32_t text_offset;
+	uint32_t data_offset;
+	uint32_t symtab_offset;
+	uint32_t strtab_offset;
+	uint32_t shstrtab_offset;
+	uint32_t shdr_offset;
+	// The data words before the trailing zeros that go in .bss
+	uint32_t data_file_words;
+	uint32_t num_symbols;
+	uint32_t strtab_size;
+	// The entry in the symbol table of the text label main, or -1 if there is none
+	int32_t main_symbol;
+	size_t size;
+} elf_layout_t;
+
+static inline int32_t add_word(word_image_t* image, uint32_t word);
+
+static inline int32_t add_words(word_image_t* image, uint32_t word, int32_t count);
+
+static inline uint32_t* reserve_words(word_image_t* image, int32_t count);
+
+static inline uint32_t image_word(word_image_t* image, int32_t index);
+
+static inline int32_t trailing_zeros(word_image_t* image);
+
+static inline void fill_repeated(char* buf, size_t size, size_t total);
+
+static inline int32_t run_length(uint32_t* words, int32_t count);
+
+static inline void free_word_image(word_image_t* image);
+
+static inline int32_t parse_output_option(char* arg, output_options_t* options);
+
+static inline int32_t write_output(int fd, output_options_t* options, word_image_t* text, word_image_t* data, symbol_table_t* symbols);
+
+static inline int32_t write_all(int fd, char* buf, size_t size);
+
+static inline size_t output_size(output_options_t* options, word_image_t* text, word_image_t* data, symbol_table_t* symbols);
+
+static inline void render_output(char* buf, output_options_t* options, word_image_t* text, word_image_t* data, symbol_table_t* symbols);
+
+static inline void render_ascii(char* buf, word_image_t* text, word_image_t* data);
+
+static inline char* render_image(char* buf, word_image_t* image, int32_t count, int32_t ascii, int32_t big_endian);
+
+static inline char* render_words(char* buf, uint32_t* words, int32_t count, int32_t ascii, int32_t big_endian);
+
+static inline char* render_run(char* buf, uint32_t word, int32_t count, int32_t ascii, int32_t big_endian);
+
+static inline void render_bin(char* buf, int32_t big_endian, word_image_t* text, word_image_t* data);
+
+static inline int32_t elf_segments_fit(word_image_t* text, word_image_t* data);
+
+static inline void elf_layout(word_image_t* text, word_image_t* data, symbol_table_t* symbols, elf_layout_t* layout);
+
+static inline void render_elf(char* buf, int32_t big_endian, word_image_t* text, word_image_t* data, symbol_table_t* symbols);
+
+static inline char* put_u16(char* ptr, uint16_t val, int32_t big_endian);
+
+static inline char* put_u32(char* ptr, uint32_t val, int32_t big_endian);
+
+static inline char* put_segment(char* ptr, word_image_t* image, int32_t big_endian);
+
+/*
+ * =====================================================================================
+ * Adds a word to the end of the image. Returns FALSE if we ran out of memory.
+ * =====================================================================================
+ */
+static inline int32_t add_word(word_image_t* image, uint32_t word)
+{
+	if (image->stored == image->capacity)
+	{
+		int32_t capacity = (image->capacity == 0) ? 1024 : image->capacity * 2;
+		uint32_t *words = (uint32_t*) counted_realloc(image->words, sizeof(uint32_t) * capacity);
+		if (words == NULL)
+			return FALSE;
+		image->words = words;
+		image->capacity = capacity;
+	}
+	image->words[image->stored++] = word;
+	image->count++;
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Adds count copies of a word to the end of the image. At least WORD_RUN_MIN of them
+ * are a run, which goes on the end of the last run if that is the same word and
+ * nothing came after it. Returns FALSE if we ran out of memory.
+ * =====================================================================================
+ */
+static inline int32_t add_words(word_image_t* image, uint32_t word, int32_t count)
+{
+	uint32_t *words;
+	word_run_t *last;
+
+	if (count <= 0)
+		return TRUE;
+	if (count > INT32_MAX - image->count)
+		return FALSE;
+	if (count < WORD_RUN_MIN)
+	{
+		words = reserve_words(image, count);
+		if (words == NULL)
+			return FALSE;
+		words[0] = word;
+		fill_repeated((char*) words, sizeof(uint32_t), sizeof(uint32_t) * (size_t) count);
+		return TRUE;
+	}
+
+	last = (image->num_runs > 0) ? &image->runs[image->num_runs - 1] : NULL;
+	if (last == NULL || last->word != word || last->start + last->count != image->count)
+	{
+		if (image->num_runs == image->runs_capacity)
+		{
+			int32_t capacity = (image->runs_capacity == 0) ? 16 : image->runs_capacity * 2;
+			word_run_t *runs = (word_run_t*) counted_realloc(image->runs, sizeof(word_run_t) * capacity);
+			if (runs == NULL)
+				return FALSE;
+			image->runs = runs;
+			image->runs_capacity = capacity;
+		}
+		last = &image->runs[image->num_runs++];
+		last->word = word;
+		last->start = image->count;
+		last->count = 0;
+		last->at = image->stored;
+	}
+	last->count += count;
+	image->count += count;
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Adds count zero words to the end of the image, stored rather than as a run, and
+ * returns the first of them, or NULL if we ran out of memory. The image grows at most
+ * once.
+ * =====================================================================================
+ */
+static inline uint32_t* reserve_words(word_image_t* image, int32_t count)
+{
+	uint32_t *words;
+
+	if (count > INT32_MAX - image->count)
+		return NULL;
+	if (image->stored + count > image->capacity)
+	{
+		int32_t capacity = (image->capacity == 0) ? 1024 : image->capacity;
+
+		while (capacity < image->stored + count)
+			capacity = (capacity > INT32_MAX / 2) ? INT32_MAX : capacity * 2;
+		words = (uint32_t*) counted_realloc(image->words, sizeof(uint32_t) * (size_t) capacity);
+		if (words == NULL)
+			return NULL;
+		image->words = words;
+		image->capacity = capacity;
+	}
+	words = image->words + image->stored;
+	memset(words, 0, sizeof(uint32_t) * (size_t) count);
+	image->stored += count;
+	image->count += count;
+	return words;
+}
+
+/*
+ * =====================================================================================
+ * Returns the word at index (below image->count) in the image, whether it is stored or
+ * in a run.
+ * =====================================================================================
+ */
+static inline uint32_t image_word(word_image_t* image, int32_t index)
+{
+	int32_t low = 0, high = image->num_runs, mid;
+	word_run_t *run;
+
+	// Find the last run that starts at or before index
+	while (low < high)
+	{
+		mid = low + (high - low) / 2;
+		if (image->runs[mid].start <= index)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low == 0)
+		return image->words[index];
+	run = &image->runs[low - 1];
+	if (index < run->start + run->count)
+		return run->word;
+	return image->words[run->at + index - (run->start + run->count)];
+}
+
+/*
+ * =====================================================================================
+ * Returns how many zero words are at the end of the image. A run counts all at once.
+ * =====================================================================================
+ */
+static inline int32_t trailing_zeros(word_image_t* image)
+{
+	int32_t stored = image->stored, r = image->num_runs, zeros = 0;
+
+	for (;;)
+	{
+		// The stored words after run r - 1, then the run itself
+		int32_t first = (r > 0) ? image->runs[r - 1].at : 0;
+
+		while (stored > first && image->words[stored - 1] == 0)
+		{
+			stored--;
+			zeros++;
+		}
+		if (stored > first || r == 0 || image->runs[r - 1].word != 0)
+			return zeros;
+		zeros += image->runs[--r].count;
+	}
+}
+
+/*
+ * =====================================================================================
+ * buf starts with size bytes that are repeated until total bytes (a multiple of size)
+ * are filled. Each copy doubles what is there, so it is a handful of large memcpy
+ * calls however many repeats there are.
+ * =====================================================================================
+ */
+static inline void fill_repeated(char* buf, size_t size, size_t total)
+{
+	size_t filled = size;
+
+	while (filled < total)
+	{
+		size_t chunk = (filled < total - filled) ? filled : total - filled;
+		memcpy(buf + filled, buf, chunk);
+		filled += chunk;
+	}
+}
+
+/*
+ * =====================================================================================
+ * Returns how many words in a row, starting with the first one, are the same. count is
+ * at least one.
+ * =====================================================================================
+ */
+static inline int32_t run_length(uint32_t* words, int32_t count)
+{
+	int32_t run = 1;
+
+	while (run < count && words[run] == words[0])
+		run++;
+	return run;
+}
+
+/*
+ * =====================================================================================
+ * Frees the words and runs of the image.
+ * =====================================================================================
+ */
+static inline void free_word_image(word_image_t* image)
+{
+	free(image->words);
+	free(image->runs);
+	image->words = NULL;
+	image->runs = NULL;
+	image->count = image->stored = image->capacity = 0;
+	image->num_runs = image->runs_capacity = 0;
+}
+
+/*
+ * =====================================================================================
+ * Handles a --format= or --endian= command line argument. Returns FALSE if arg is not
+ * one of them or has a value we don't know.
+ * =====================================================================================
+ */
+static inline int32_t parse_output_option(char* arg, output_options_t* options)
+{
+	if (strcmp(arg, "--format=ascii") == 0)
+		options->format = FORMAT_ASCII;
+	else if (strcmp(arg, "--format=bin") == 0)
+		options->format = FORMAT_BIN;
+	else if (strcmp(arg, "--format=elf") == 0)
+		options->format = FORMAT_ELF;
+	else if (strcmp(arg, "--endian=big") == 0)
+		options->big_endian = TRUE;
+	else if (strcmp(arg, "--endian=little") == 0)
+		options->big_endian = FALSE;
+	else
+		return FALSE;
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Writes the assembled program to fd in the format the options ask for. symbols is
+ * only used for elf. If fd is an empty regular file it is set to the size of the output and
+ * the output is rendered straight into a mapping of it, otherwise it is rendered into
+ * a buffer and written out in large pieces. Returns FALSE if the output could not be
+ * written.
+ * =====================================================================================
+ */
+static inline int32_t write_output(int fd, output_options_t* options, word_image_t* text, word_image_t* data, symbol_table_t* symbols)
+{
+	size_t size = output_size(options, text, data, symbols);
+	struct stat st;
+	char *buf;
+	int32_t ok;
+
+	// Only map an empty file we are at the start of, so a redirected stdout that
+	// already has something in it gets added to rather than truncated
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == 0 &&
+		lseek(fd, 0, SEEK_CUR) == 0 && size > 0)
+	{
+		// The blocks have to be allocated before the file is mapped. If it were only
+		// sized, running out of disk space while rendering would be a SIGBUS instead
+		// of an error.
+		if (posix_fallocate(fd, 0, size) == 0)
+		{
+			buf = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (buf != MAP_FAILED)
+			{
+				// A freshly allocated file reads as zeros, which is what render_output expects
+				render_output(buf, options, text, data, symbols);
+				return (munmap(buf, size) == 0) ? TRUE : FALSE;
+			}
+		}
+		// Drop whatever was allocated, so write() starts over on an empty file
+		if (ftruncate(fd, 0) != 0)
+			return FALSE;
+	}
+
+	buf = (char*) counted_calloc(1, size);
+	if (buf == NULL)
+		return FALSE;
+	render_output(buf, options, text, data, symbols);
+	ok = write_all(fd, buf, size);
+	free(buf);
+	return ok;
+}
+
+/*
+ * =====================================================================================
+ * Writes size bytes from buf to fd, at most OUTPUT_WRITE_CHUNK at a time, going on
+ * after short writes and interruptions. Returns FALSE if a write failed.
+ * =====================================================================================
+ */
+static inline int32_t write_all(int fd, char* buf, size_t size)
+{
+	ssize_t written;
+
+	while (size > 0)
+	{
+		written = write(fd, buf, (size < OUTPUT_WRITE_CHUNK) ? size : OUTPUT_WRITE_CHUNK);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		buf += written;
+		size -= written;
+	}
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Returns the number of bytes the output takes in the format the options ask for.
+ * =====================================================================================
+ */
+static inline size_t output_size(output_options_t* options, word_image_t* text, word_image_t* data, symbol_table_t* symbols)
+{
+	elf_layout_t layout;
+
+	if (options->format == FORMAT_BIN)
+		return BIN_HEADER_SIZE + BIN_RUN_SIZE * ((size_t) text->num_runs + data->num_runs) +
+			sizeof(uint32_t) * ((size_t) text->stored + data->stored);
+	else if (options->format == FORMAT_ELF)
+	{
+		elf_layout(text, data, symbols, &layout);
+		return layout.size;
+	}
+	// A line for each word and the blank line between the segments
+	return WORD_TEXT_LENGTH * ((size_t) text->count + data->count) + 1;
+}
+
+/*
+ * =====================================================================================
+ * Renders the output into buf, which has room for output_size bytes and is all zeros.
+ * =====================================================================================
+ */
+static inline void render_output(char* buf, output_options_t* options, word_image_t* text, word_image_t* data, symbol_table_t* symbols)
+{
+	if (options->format == FORMAT_BIN)
+		render_bin(buf, options->big_endian, text, data);
+	else if (options->format == FORMAT_ELF)
+		render_elf(buf, options->big_endian, text, data, symbols);
+	else
+		render_ascii(buf, text, data);
+}
+
+/*
+ * =====================================================================================
+ * Renders each word as a line of 32 '0'/'1' characters. The text segment comes first,
+ * then a blank line, then the data segment.
+ * =====================================================================================
+ */
+static inline void render_ascii(char* buf, word_image_t* text, word_image_t* data)
+{
+	buf = render_image(buf, text, text->count, TRUE, FALSE);
+	*buf++ = '\n';
+	render_image(buf, data, data->count, TRUE, FALSE);
+}
+
+/*
+ * =====================================================================================
+ * Renders the first count words of the image at buf, runs included, and returns the
+ * spot after them. Each word is a line of text if ascii is TRUE and a 32 bit word in
+ * the given byte order if it isn't.
+ * =====================================================================================
+ */
+static inline char* render_image(char* buf, word_image_t* image, int32_t count, int32_t ascii, int32_t big_endian)
+{
+	int32_t stored = 0, done = 0, r, n;
+
+	for (r = 0; done < count; r++)
+	{
+		// The stored words before run r (or after the last run), then the run
+		n = ((r < image->num_runs) ? image->runs[r].at : image->stored) - stored;
+		n = (n < count - done) ? n : count - done;
+		buf = render_words(buf, image->words + stored, n, ascii, big_endian);
+		stored += n;
+		done += n;
+		if (r < image->num_runs && done < count)
+		{
+			n = (image->runs[r].count < count - done) ? image->runs[r].count : count - done;
+			buf = render_run(buf, image->runs[r].word, n, ascii, big_endian);
+			done += n;
+		}
+	}
+	return buf;
+}
+
+/*
+ * =====================================================================================
+ * Renders count stored words at buf as render_image does and returns the spot after
+ * them. A word repeated in a row is rendered once and copied.
+ * =====================================================================================
+ */
+static inline char* render_words(char* buf, uint32_t* words, int32_t count, int32_t ascii, int32_t big_endian)
+{
+	int32_t i, run;
+
+	for (i = 0; i < count; i += run)
+	{
+		run = run_length(words + i, count - i);
+		buf = render_run(buf, words[i], run, ascii, big_endian);
+	}
+	return buf;
+}
+
+/*
+ * =====================================================================================
+ * Renders count copies of word at buf as render_image does and returns the spot after
+ * them. The word is rendered once and copied.
+ * =====================================================================================
+ */
+static inline char* render_run(char* buf, uint32_t word, int32_t count, int32_t ascii, int32_t big_endian)
+{
+	size_t size = (ascii == TRUE) ? WORD_TEXT_LENGTH : sizeof(uint32_t);
+
+	if (ascii == TRUE)
+		render_word(word, buf);
+	else
+		put_u32(buf, word, big_endian);
+	fill_repeated(buf, size, size * (size_t) count);
+	return buf + size * (size_t) count;
+}
+
+/*
+ * =====================================================================================
+ * Renders the segments with a small header in front:
+ *
+ *   magic, version,
+ *   text address, text size in bytes, number of text runs,
+ *   data address, data size in bytes, number of data runs
+ *
+ * and then each segment as put_segment lays it out. Every field and word is 32 bits
+ * in the given byte order.
+ * =====================================================================================
+ */
+static inline void render_bin(char* buf, int32_t big_endian, word_image_t* text, word_image_t* data)
+{
+	char *ptr = buf;
+
+	ptr = put_u32(ptr, BIN_MAGIC, big_endian);
+	ptr = put_u32(ptr, BIN_VERSION, big_endian);
+	ptr = put_u32(ptr, text->address, big_endian);
+	ptr = put_u32(ptr, sizeof(uint32_t) * text->count, big_endian);
+	ptr = put_u32(ptr, text->num_runs, big_endian);
+	ptr = put_u32(ptr, data->address, big_endian);
+	ptr = put_u32(ptr, sizeof(uint32_t) * data->count, big_endian);
+	ptr = put_u32(ptr, data->num_runs, big_endian);
+	ptr = put_segment(ptr, text, big_endian);
+	ptr = put_segment(ptr, data, big_endian);
+}
+
+/*
+ * =====================================================================================
+ * Returns TRUE if the text segment ends before the data segment starts. If it doesn't,
+ * the two overlap and can't be loaded from an elf file. The data addresses are already
+ * encoded in the instructions, so the data segment can't be moved out of the way.
+ * =====================================================================================
+ */
+static inline int32_t elf_segments_fit(word_image_t* text, word_image_t* data)
+{
+	uint64_t text_end = (uint64_t)(uint32_t) text->address + sizeof(uint32_t) * (uint64_t) text->count;
+
+	return (text_end <= (uint32_t) data->address) ? TRUE : FALSE;
+}
+
+/*
+ * =====================================================================================
+ * Works out where everything goes in an elf file. The file is laid out as
+ *
+ *   ELF header, program headers (one PT_LOAD for each segment), .text, .data,
+ *   .symtab, .strtab, .shstrtab, section headers
+ *
+ * .data stops before the zero words at the end of the data segment. Those are .bss,
+ * which has no bytes in the file.
+ * =====================================================================================
+ */
+static inline void elf_layout(word_image_t* text, word_image_t* data, symbol_table_t* symbols, elf_layout_t* layout)
+{
+	uint32_t i;
+
+	layout->data_file_words = data->count - trailing_zeros(data);
+
+	// Count the labels and the room their names take in .strtab
+	layout->num_symbols = 1 + symbols->count;
+	layout->strtab_size = 1;
+	layout->main_symbol = -1;
+	for (i = 0; i < symbols->count; i++)
+	{
+		symbol_entry_t *entry = &symbols->entries[i];
+
+		layout->strtab_size += entry->key_len + 1;
+		if (entry->symbol.kind == SYMBOL_TEXT_LABEL && entry->key_len == strlen("main") &&
+			memcmp(symbol_key(symbols, entry), "main", entry->key_len) == 0)
+			layout->main_symbol = i;
+	}
+
+	layout->text_offset = sizeof(Elf32_Ehdr) + ELF_NUM_PHDRS * sizeof(Elf32_Phdr);
+	layout->data_offset = layout->text_offset + sizeof(uint32_t) * text->count;
+	layout->symtab_offset = layout->data_offset + sizeof(uint32_t) * layout->data_file_words;
+	layout->strtab_offset = layout->symtab_offset + layout->num_symbols * sizeof(Elf32_Sym);
+	layout->shstrtab_offset = layout->strtab_offset + layout->strtab_size;
+	layout->shdr_offset = (layout->shstrtab_offset + sizeof(ELF_SHSTRTAB) + 3) & ~3;
+	layout->size = layout->shdr_offset + ELF_NUM_SECTIONS * sizeof(Elf32_Shdr);
+}
+
+/*
+ * =====================================================================================
+ * Renders an ELF32 MIPS executable laid out as elf_layout says. Every label in symbols
+ * goes in .symtab as a local symbol in its section (.bss for the labels in the zeros at
+ * the end of the data segment), with the size of the data it names.
+ * =====================================================================================
+ */
+static inline void render_elf(char* buf, int32_t big_endian, word_image_t* text, word_image_t* data, symbol_table_t* symbols)
+{
+	elf_layout_t layout;
+	uint32_t text_size = sizeof(uint32_t) * text->count;
+	uint32_t data_size = sizeof(uint32_t) * data->count;
+	uint32_t data_file_size, bss_address;
+	uint32_t name, i, j;
+	symbol_entry_t *entry;
+	char *ptr, *strtab;
+
+	elf_layout(text, data, symbols, &layout);
+	data_file_size = sizeof(uint32_t) * layout.data_file_words;
+	bss_address = data->address + data_file_size;
+
+	// ELF header
+	ptr = buf;
+	memcpy(ptr, ELFMAG, SELFMAG);
+	ptr[EI_CLASS] = ELFCLASS32;
+	ptr[EI_DATA] = (big_endian == TRUE) ? ELFDATA2MSB : ELFDATA2LSB;
+	ptr[EI_VERSION] = EV_CURRENT;
+	ptr[EI_OSABI] = ELFOSABI_SYSV;
+	ptr += EI_NIDENT;
+	ptr = put_u16(ptr, ET_EXEC, big_endian);
+	ptr = put_u16(ptr, EM_MIPS, big_endian);
+	ptr = put_u32(ptr, EV_CURRENT, big_endian);
+	ptr = put_u32(ptr, (layout.main_symbol >= 0) ? (uint32_t) symbols->entries[layout.main_symbol].symbol.address : text->address, big_endian);
+	ptr = put_u32(ptr, sizeof(Elf32_Ehdr), big_endian);
+	ptr = put_u32(ptr, layout.shdr_offset, big_endian);
+	ptr = put_u32(ptr, EF_MIPS_ARCH_32, big_endian);
+	ptr = put_u16(ptr, sizeof(Elf32_Ehdr), big_endian);
+	ptr = put_u16(ptr, sizeof(Elf32_Phdr), big_endian);
+	ptr = put_u16(ptr, ELF_NUM_PHDRS, big_endian);
+	ptr = put_u16(ptr, sizeof(Elf32_Shdr), big_endian);
+	ptr = put_u16(ptr, ELF_NUM_SECTIONS, big_endian);
+	ptr = put_u16(ptr, ELF_NUM_SECTIONS - 1, big_endian);
+
+	// Program headers: type, offset, vaddr, paddr, filesz, memsz, flags, align
+	ptr = put_u32(ptr, PT_LOAD, big_endian);
+	ptr = put_u32(ptr, layout.text_offset, big_endian);
+	ptr = put_u32(ptr, text->address, big_endian);
+	ptr = put_u32(ptr, text->address, big_endian);
+	ptr = put_u32(ptr, text_size, big_endian);
+	ptr = put_u32(ptr, text_size, big_endian);
+	ptr = put_u32(ptr, PF_R | PF_X, big_endian);
+	ptr = put_u32(ptr, sizeof(uint32_t), big_endian);
+
+	ptr = put_u32(ptr, PT_LOAD, big_endian);
+	ptr = put_u32(ptr, layout.data_offset, big_endian);
+	ptr = put_u32(ptr, data->address, big_endian);
+	ptr = put_u32(ptr, data->address, big_endian);
+	ptr = put_u32(ptr, data_file_size, big_endian);
+	ptr = put_u32(ptr, data_size, big_endian);
+	ptr = put_u32(ptr, PF_R | PF_W, big_endian);
+	ptr = put_u32(ptr, sizeof(uint32_t), big_endian);
+
+	// The segments, without the .bss zeros
+	ptr = render_image(ptr, text, text->count, FALSE, big_endian);
+	ptr = render_image(ptr, data, layout.data_file_words, FALSE, big_endian);
+
+	// Symbol table: name, value, size, info, other, section. The first one stays all zeros.
+	ptr += sizeof(Elf32_Sym);
+	strtab = buf + layout.strtab_offset;
+	name = 1;
+	for (i = 0; i < symbols->count; i++)
+	{
+		// main is global and the globals have to come after the locals, so it goes last
+		j = i;
+		if (layout.main_symbol >= 0 && i >= (uint32_t) layout.main_symbol)
+			j = (i == symbols->count - 1) ? (uint32_t) layout.main_symbol : i + 1;
+		entry = &symbols->entries[j];
+		uint16_t section = ELF_TEXT_SECTION;
+
+		if (entry->symbol.section == SECTION_DATA)
+			section = ((uint32_t) entry->symbol.address < bss_address) ? ELF_DATA_SECTION : ELF_BSS_SECTION;
+
+		memcpy(strtab + name, symbol_key(symbols, entry), entry->key_len);
+		ptr = put_u32(ptr, name, big_endian);
+		ptr = put_u32(ptr, entry->symbol.address, big_endian);
+		ptr = put_u32(ptr, entry->symbol.size, big_endian);
+		*ptr++ = ELF32_ST_INFO((j == (uint32_t) layout.main_symbol) ? STB_GLOBAL : STB_LOCAL,
+			(entry->symbol.kind == SYMBOL_TEXT_LABEL) ? STT_FUNC : STT_OBJECT);
+		*ptr++ = STV_DEFAULT;
+		ptr = put_u16(ptr, section, big_endian);
+		name += entry->key_len + 1;
+	}
+
+	memcpy(buf + layout.shstrtab_offset, ELF_SHSTRTAB, sizeof(ELF_SHSTRTAB));
+
+	// Section headers: name, type, flags, addr, offset, size, link, info, addralign, entsize.
+	// The names are offsets into ELF_SHSTRTAB and the first header stays all zeros.
+	ptr = buf + layout.shdr_offset + sizeof(Elf32_Shdr);
+
+	ptr = put_u32(ptr, 1, big_endian);
+	ptr = put_u32(ptr, SHT_PROGBITS, big_endian);
+	ptr = put_u32(ptr, SHF_ALLOC | SHF_EXECINSTR, big_endian);
+	ptr = put_u32(ptr, text->address, big_endian);
+	ptr = put_u32(ptr, layout.text_offset, big_endian);
+	ptr = put_u32(ptr, text_size, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, sizeof(uint32_t), big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+
+	ptr = put_u32(ptr, 7, big_endian);
+	ptr = put_u32(ptr, SHT_PROGBITS, big_endian);
+	ptr = put_u32(ptr, SHF_ALLOC | SHF_WRITE, big_endian);
+	ptr = put_u32(ptr, data->address, big_endian);
+	ptr = put_u32(ptr, layout.data_offset, big_endian);
+	ptr = put_u32(ptr, data_file_size, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, sizeof(uint32_t), big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+
+	// .bss starts where the file part of .data ends
+	ptr = put_u32(ptr, 13, big_endian);
+	ptr = put_u32(ptr, SHT_NOBITS, big_endian);
+	ptr = put_u32(ptr, SHF_ALLOC | SHF_WRITE, big_endian);
+	ptr = put_u32(ptr, bss_address, big_endian);
+	ptr = put_u32(ptr, layout.symtab_offset, big_endian);
+	ptr = put_u32(ptr, data_size - data_file_size, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, sizeof(uint32_t), big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+
+	// .symtab links to .strtab, and info is one past the last local symbol
+	ptr = put_u32(ptr, 18, big_endian);
+	ptr = put_u32(ptr, SHT_SYMTAB, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, layout.symtab_offset, big_endian);
+	ptr = put_u32(ptr, layout.num_symbols * sizeof(Elf32_Sym), big_endian);
+	ptr = put_u32(ptr, 5, big_endian);
+	ptr = put_u32(ptr, layout.num_symbols - ((layout.main_symbol >= 0) ? 1 : 0), big_endian);
+	ptr = put_u32(ptr, sizeof(uint32_t), big_endian);
+	ptr = put_u32(ptr, sizeof(Elf32_Sym), big_endian);
+
+	ptr = put_u32(ptr, 26, big_endian);
+	ptr = put_u32(ptr, SHT_STRTAB, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, layout.strtab_offset, big_endian);
+	ptr = put_u32(ptr, layout.strtab_size, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, 1, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+
+	ptr = put_u32(ptr, 34, big_endian);
+	ptr = put_u32(ptr, SHT_STRTAB, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, layout.shstrtab_offset, big_endian);
+	ptr = put_u32(ptr, sizeof(ELF_SHSTRTAB), big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+	ptr = put_u32(ptr, 1, big_endian);
+	ptr = put_u32(ptr, 0, big_endian);
+
+}
+
+/*
+ * =====================================================================================
+ * Stores a 16 bit value at ptr in the given byte order and returns the spot after it.
+ * =====================================================================================
+ */
+static inline char* put_u16(char* ptr, uint16_t val, int32_t big_endian)
+{
+	if (big_endian == TRUE)
+	{
+		ptr[0] = (char)(val >> 8);
+		ptr[1] = (char)(val);
+	}
+	else
+	{
+		ptr[0] = (char)(val);
+		ptr[1] = (char)(val >> 8);
+	}
+	return ptr + 2;
+}
+
+/*
+ * =====================================================================================
+ * Stores a 32 bit value at ptr in the given byte order and returns the spot after it.
+ * =====================================================================================
+ */
+static inline char* put_u32(char* ptr, uint32_t val, int32_t big_endian)
+{
+	if (big_endian == TRUE)
+	{
+		ptr[0] = (char)(val >> 24);
+		ptr[1] = (char)(val >> 16);
+		ptr[2] = (char)(val >> 8);
+		ptr[3] = (char)(val);
+	}
+	else
+	{
+		ptr[0] = (char)(val);
+		ptr[1] = (char)(val >> 8);
+		ptr[2] = (char)(val >> 16);
+		ptr[3] = (char)(val >> 24);
+	}
+	return ptr + 4;
+}
+
+/*
+ * =====================================================================================
+ * Stores a segment of a bin file at ptr and returns the spot after it. The segment is
+ * a record for each run of the image:
+ *
+ *   index of the first word of the run in the segment, number of words, the word
+ *
+ * in order, and then the stored words, which fill the gaps between the runs.
+ * =====================================================================================
+ */
+static inline char* put_segment(char* ptr, word_image_t* image, int32_t big_endian)
+{
+	int32_t r;
+
+	for (r = 0; r < image->num_runs; r++)
+	{
+		ptr = put_u32(ptr, image->runs[r].start, big_endian);
+		ptr = put_u32(ptr, image->runs[r].count, big_endian);
+		ptr = put_u32(ptr, image->runs[r].word, big_endian);
+	}
+	return render_words(ptr, image->words, image->stored, FALSE, big_endian);
+}
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef __SOURCE_H_
+#define __SOURCE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "counters.h"
+
+#define TRUE 1
+#define FALSE 0
+#define SOURCE_READ_CHUNK 65536
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  source.h
+ *
+ * Description: Input layer for the assembler. The source file is mapped into memory
+ * once (or read in with read() when it can't be mapped, like a pipe) and every pass
+ * walks it as line slices - a pointer into the mapping and a length - so nothing gets
+ * copied just to find where the lines are. The zeroth pass merges the sections by
+ * putting the slices in the order the other passes should see them (see utilities.h).
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+typedef struct
+{
+	char *start;
+	size_t len;
+} line_t;
+
+typedef struct
+{
+	char *data;
+	size_t len;
+	int32_t mapped;
+} source_t;
+
+static inline int32_t open_source(char* src_file, source_t* src);
+
+static inline void close_source(source_t* src);
+
+static inline int32_t next_line(char** cursor, char* end, line_t* line);
+
+static inline int32_t line_contains(line_t* line, const char* str);
+
+static inline char* copy_line(char* line, int size, line_t* slice);
+
+/*
+ * =====================================================================================
+ * Opens src_file and maps it into memory. If the file can't be mapped (a pipe, or
+ * an empty file) it is read into a heap buffer instead. A src_file of - is stdin,
+ * which gets read in whole before any pass starts. Returns TRUE on success.
+ * =====================================================================================
+ */
+static inline int32_t open_source(char* src_file, source_t* src)
+{
+	struct stat st;
+	ssize_t got;
+	size_t capacity;
+	int32_t regular_file;
+	int fd;
+
+	src->data = NULL;
+	src->len = 0;
+	src->mapped = FALSE;
+
+	// Our own copy of stdin, so it can be closed like any other file
+	fd = (strcmp(src_file, "-") == 0) ? dup(STDIN_FILENO) : open(src_file, O_RDONLY);
+	if (fd < 0)
+		return FALSE;
+
+	// A redirected stdin may not be at the start of the file, so only map from the start
+	regular_file = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_CUR) == 0);
+	if (regular_file == TRUE && st.st_size > 0)
+	{
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			// We go through the file from front to back
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			src->data = (char*) map;
+			src->len = st.st_size;
+			src->mapped = TRUE;
+			close(fd);
+			return TRUE;
+		}
+	}
+
+	// Fall back to reading the whole thing in big chunks
+	capacity = (regular_file == TRUE && st.st_size > 0) ? (size_t) st.st_size : SOURCE_READ_CHUNK;
+	src->data = (char*) counted_malloc(capacity);
+	if (src->data == NULL)
+	{
+		close(fd);
+		return FALSE;
+	}
+	while (1)
+	{
+		if (src->len == capacity)
+		{
+			char *bigger = (char*) counted_realloc(src->data, capacity * 2);
+			if (bigger == NULL)
+			{
+				close_source(src);
+				close(fd);
+				return FALSE;
+			}
+			src->data = bigger;
+			capacity *= 2;
+		}
+		got = read(fd, src->data + src->len, capacity - src->len);
+		if (got == 0)
+			break;
+		if (got < 0)
+		{
+			close_source(src);
+			close(fd);
+			return FALSE;
+		}
+		src->len += got;
+	}
+	close(fd);
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Unmaps or frees the source.
+ * =====================================================================================
+ */
+static inline void close_source(source_t* src)
+{
+	if (src->mapped == TRUE)
+		munmap(src->data, src->len);
+	else
+		free(src->data);
+	src->data = NULL;
+	src->len = 0;
+	src->mapped = FALSE;
+}
+
+/*
+ * =====================================================================================
+ * Gets the next line between cursor and end, newline included, and moves cursor past
+ * it. Returns FALSE when there are no lines left.
+ * =====================================================================================
+ */
+static inline int32_t next_line(char** cursor, char* end, line_t* line)
+{
+	char *start = *cursor;
+	char *newline;
+
+	if (start >= end)
+		return FALSE;
+
+	newline = (char*) memchr(start, '\n', end - start);
+	line->start = start;
+	line->len = (newline == NULL) ? (size_t)(end - start) : (size_t)(newline - start + 1);
+	*cursor = start + line->len;
+	run_counters.lines_read++;
+	return TRUE;
+}
+
+/*
+ * =====================================================================================
+ * strstr for a line slice. Returns TRUE if str shows up anywhere in the line.
+ * =====================================================================================
+ */
+static inline int32_t line_contains(line_t* line, const char* str)
+{
+	size_t str_len = strlen(str);
+	char *ptr = line->start;
+	char *end = line->start + line->len;
+
+	while ((size_t)(end - ptr) >= str_len)
+	{
+		ptr = (char*) memchr(ptr, str[0], end - ptr - str_len + 1);
+		if (ptr == NULL)
+			return FALSE;
+		if (memcmp(ptr, str, str_len) == 0)
+			return TRUE;
+		ptr++;
+	}
+	return FALSE;
+}
+
+/*
+ * =====================================================================================
+ * Copies a line slice into line (at most size - 1 characters) and null terminates
+ * it, for code that needs a C string to tokenize. Returns line.
+ * =====================================================================================
+ */
+static inline char* copy_line(char* line, int size, line_t* slice)
+{
+	size_t len = slice->len;
+
+	if (len > (size_t)(size - 1))
+		len = size - 1;
+	memcpy(line, slice->start, len);
+	line[len] = '\0';
+	return line;
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef __STATS_H_
+#define __STATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "counters.h"
+
+#define TRUE 1
+#define FALSE 0
+// What --stats prints
+#define STATS_NONE 0
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  stats.h
+ *
+ * Description: What --stats reports about one assembly: how long each pass took, the
+ * counters from counters.h, how big the symbol table got and how much was emitted. It
+ * is printed either as text for people or as one line of JSON for scripts.
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+// The timed parts of an assembly. The single pass replaces the other three passes.
+enum
+{
+	STAGE_ZEROTH, STAGE_FIRST, STAGE_SECOND, STAGE_SINGLE, STAGE_OUTPUT, NUM_STAGES
+};
+
+static const char *stage_names[NUM_STAGES] = { "zeroth", "first", "second", "single", "output" };
+
+typedef struct
+{
+	double seconds[NUM_STAGES];
+	run_counters_t counters;
+	uint32_t symbols;
+	uint32_t symbol_slots;
+	int32_t text_words;
+	int32_t data_words;
+	uint64_t output_bytes;
+	int32_t cached;
+} assembly_stats_t;
+
+static inline double seconds_since(struct timespec* start);
+
+static inline void print_stats(FILE* out, int32_t format, const char* src_file, assembly_stats_t* stats);
+
+static inline void print_stats_text(FILE* out, const char* src_file, assembly_stats_t* stats);
+
+static inline void print_stats_json(FILE* out, const char* src_file, assembly_stats_t* stats);
+
+static inline void print_json_string(FILE* out, const char* str);
+
+/*
+ * =====================================================================================
+ * Returns how many seconds have gone by since start (from CLOCK_MONOTONIC).
+ * =====================================================================================
+ */
+static inline double seconds_since(struct timespec* start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * =====================================================================================
+ * Prints the stats for src_file to out as STATS_TEXT or STATS_JSON. The stream is
+ * locked while they are printed, so the stats of files assembled at the same time
+ * don't get mixed up.
+ * =====================================================================================
+ */
+static inline void print_stats(FILE* out, int32_t format, const char* src_file, assembly_stats_t* stats)
+{
+	flockfile(out);
+	if (format == STATS_JSON)
+		print_stats_json(out, src_file, stats);
+	else if (format == STATS_TEXT)
+		print_stats_text(out, src_file, stats);
+	funlockfile(out);
+}
+
+/*
+ * =====================================================================================
+ * Prints the stats as a block of text, one thing per line.
+ * =====================================================================================
+ */
+static inline void print_stats_text(FILE* out, const char* src_file, assembly_stats_t* stats)
+{
+	run_counters_t *counters = &stats->counters;
+	int32_t i;
+
+	fprintf(out, "Stats for %s%s:\n", src_file, (stats->cached == TRUE) ? " (copied from the cache)" : "");
+	for (i = 0; i < NUM_STAGES; i++)
+	{
+		if (stats->seconds[i] > 0)
+			fprintf(out, "  %-16s %.6f s\n", stage_names[i], stats->seconds[i]);
+	}
+	fprintf(out, "  %-16s %llu\n", "lines read", (unsigned long long) counters->lines_read);
+	fprintf(out, "  %-16s %llu\n", "tokens", (unsigned long long) counters->tokens);
+	fprintf(out, "  %-16s %u symbols in %u slots, %llu lookups, %.2f probes per lookup, longest %llu\n",
+		"symbol table", stats->symbols, stats->symbol_slots, (unsigned long long) counters->symbol_lookups,
+		(counters->symbol_lookups == 0) ? 0.0 : (double) counters->symbol_probes / counters->symbol_lookups,
+		(unsigned long long) counters->symbol_longest_probe);
+	fprintf(out, "  %-16s %llu lookups, %.2f probes per lookup, longest %llu\n",
+		"fixup table", (unsigned long long) counters->hash_lookups,
+		(counters->hash_lookups == 0) ? 0.0 : (double) counters->hash_probes / counters->hash_lookups,
+		(unsigned long long) counters->hash_longest_probe);
+	fprintf(out, "  %-16s %llu (%llu bytes)\n", "allocations",
+		(unsigned long long) counters->allocations, (unsigned long long) counters->bytes_allocated);
+	fprintf(out, "  %-16s %d words (%d bytes)\n", "text segment", stats->text_words, stats->text_words * 4);
+	fprintf(out, "  %-16s %d words (%d bytes)\n", "data segment", stats->data_words, stats->data_words * 4);
+	fprintf(out, "  %-16s %llu bytes\n", "output file", (unsigned long long) stats->output_bytes);
+}
+
+/*
+ * =====================================================================================
+ * Prints the stats as one JSON object on one line.
+ * =====================================================================================
+ */
+static inline void print_stats_json(FILE* out, const char* src_file, assembly_stats_t* stats)
+{
+	run_counters_t *counters = &stats->counters;
+	int32_t i;
+
+	fprintf(out, "{\"file\":");
+	print_json_string(out, src_file);
+	fprintf(out, ",\"cached\":%s,\"seconds\":{", (stats->cached == TRUE) ? "true" : "false");
+	for (i = 0; i < NUM_STAGES; i++)
+		fprintf(out, "%s\"%s\":%.6f", (i == 0) ? "" : ",", stage_names[i], stats->seconds[i]);
+	fprintf(out, "},\"lines_read\":%llu,\"tokens\":%llu", (unsigned long long) counters->lines_read,
+		(unsigned long long) counters->tokens);
+	fprintf(out, ",\"symbol_table\":{\"symbols\":%u,\"slots\":%u,\"lookups\":%llu,\"probes\":%llu,\"longest_probe\":%llu}",
+		stats->symbols, stats->symbol_slots, (unsigned long long) counters->symbol_lookups,
+		(unsigned long long) counters->symbol_probes, (unsigned long long) counters->symbol_longest_probe);
+	fprintf(out, ",\"fixup_table\":{\"lookups\":%llu,\"probes\":%llu,\"longest_probe\":%llu}",
+		(unsigned long long) counters->hash_lookups, (unsigned long long) counters->hash_probes,
+		(unsigned long long) counters->hash_longest_probe);
+	fprintf(out, ",\"allocations\":%llu,\"bytes_allocated\":%llu", (unsigned long long) counters->allocations,
+		(unsigned long long) counters->bytes_allocated);
+	fprintf(out, ",\"text_words\":%d,\"data_words\":%d,\"output_bytes\":%llu}\n", stats->text_words,
+		stats->data_words, (unsigned long long) stats->output_bytes);
+}
+
+/*
+ * =====================================================================================
+ * Prints str as a JSON string, in quotes and with anything that needs it escaped.
+ * =====================================================================================
+ */
+static inline void print_json_string(FILE* out, const char* str)
+{
+	fputc('"', out);
+	for (; *str != '\0'; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			fprintf(out, "\\%c", *str);
+		else if ((unsigned char) *str < 0x20)
+			fprintf(out, "\\u%04x", (unsigned char) *str);
+		else
+			fputc(*str, out);
+	}
+	fputc('"', out);
+}
+
+#endif
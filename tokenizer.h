@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include "counters.h"
 
 
 /* parses the token in_str delimited by the characters in delim. it returns
@@ -62,4 +63,102 @@ static inline char *parse_token(char *in_str, char *delim, char **out_str, char
 }
 
 
+/* view based tokenizer. parse_token mallocs every token it returns, which
+   adds up over a big file. the functions below hand back tokens as
+   (pointer, length) views into the line instead, so tokenizing a line does
+   no allocation at all, and the line does not have to be null terminated -
+   it runs up to end.
+
+   the delimiters are given as a delim_set_t, a 256 entry table built once
+   by init_delim_set, so checking a character is a single lookup rather than
+   a strspn/strpbrk scan over the delimiter string.
+
+   ex:
+   delim_set_t ws;
+   token_view_t tok;
+   init_delim_set(&ws, " \t\n");
+   while (parse_token_view(ptr, end, &ws, &ptr, NULL, &tok))
+     printf("%.*s\n", (int) tok.len, tok.start);
+*/
+
+typedef struct
+{
+  char *start;
+  uint32_t len;
+} token_view_t;
+
+typedef struct
+{
+  unsigned char is_delim[256];
+} delim_set_t;
+
+/* builds the lookup table for the delimiter characters in delim */
+static inline void init_delim_set(delim_set_t *set, const char *delim)
+{
+  memset(set->is_delim, 0, sizeof(set->is_delim));
+  while (*delim != 0)
+    {
+      set->is_delim[(unsigned char) *delim] = 1;
+      delim++;
+    }
+}
+
+/* finds the first token in [in_str, end) delimited by the characters in set.
+   works like parse_token: leading delimiters are skipped, out_str is set to
+   just past the delimiter that ended the token and delim_char (if not NULL)
+   gets that delimiter. reaching end also ends a token, with delim_char set
+   to 0.
+
+   it returns 1 and fills in token if a token was found, 0 if the rest of the
+   line was all delimiters. */
+static inline int parse_token_view(char *in_str, char *end, delim_set_t *set, char **out_str, char *delim_char, token_view_t *token)
+{
+  char *ptr = in_str;
+  char *tptr;
+
+  /* Bypass leading whitespace delimiters */
+  while (ptr < end && set->is_delim[(unsigned char) *ptr])
+    ptr++;
+  if (ptr >= end) return(0);
+
+  /* Get end of token */
+  tptr = ptr;
+  while (tptr < end && !set->is_delim[(unsigned char) *tptr])
+    tptr++;
+
+  token->start = ptr;
+  token->len = tptr - ptr;
+  run_counters.tokens++;
+
+  if (tptr < end)
+    {
+      if (delim_char != NULL) *delim_char = *tptr;
+      *out_str = tptr + 1; /* go past the delimiter */
+    }
+  else
+    {
+      if (delim_char != NULL) *delim_char = 0;
+      *out_str = tptr;
+    }
+  return(1);
+}
+
+/* returns 1 if the token is exactly the string str */
+static inline int token_equals(token_view_t *token, const char *str)
+{
+  return (strncmp(token->start, str, token->len) == 0 && str[token->len] == 0);
+}
+
+/* copies the token into buf as a null terminated string, cutting it off at
+   size - 1 characters. returns buf. */
+static inline char *token_to_str(token_view_t *token, char *buf, uint32_t size)
+{
+  uint32_t len = token->len;
+
+  if (len > size - 1) len = size - 1;
+  memcpy(buf, token->start, len);
+  buf[len] = (char) 0;
+  return(buf);
+}
+
 #endif 
@@ -0,0 +1,220 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/*
+ * =====================================================================================
+ *
+ * Filename:  trace.h
+ *
+ * Description: A timeline of what the assembler did, for --trace. Each pass, the
+ * lexing and encoding threads, writing the output and, with --jobs, each file on the
+ * thread that assembled it, is a span with a start and a duration. The spans are
+ * written as a Chrome trace event file, which chrome://tracing and Perfetto show as
+ * one row per thread, so gaps between files and threads that finish late stand out.
+ *
+ * Tracing is off unless trace_open is called. When it is off, starting and ending a
+ * span is one test of trace_enabled each, so the calls are left in everywhere. When it
+ * is on, finished spans are added to one list under a lock; there are only a handful
+ * per file, so that is not where the time goes.
+ *
+ * Author:  Karthik Kumar, kkumar91@vt.edu
+ *
+ * =====================================================================================
+ */
+
+/*
+ * A span that has started. name has to be a string that is never freed.
+ */
+typedef struct
+{
+	const char *name;
+	struct timespec start;
+} trace_span_t;
+
+/*
+ * A finished span. detail (which file it was about) is our own copy, or NULL.
+ */
+typedef struct
+{
+	const char *name;
+	char *detail;
+	double start;
+	double duration;
+	int32_t thread;
+} trace_event_t;
+
+// Set once by trace_open, before any threads start, and only read after that
+static int32_t trace_enabled = FALSE;
+
+static struct timespec trace_start;
+
+static trace_event_t *trace_events = NULL;
+
+static int32_t trace_count = 0;
+
+static int32_t trace_capacity = 0;
+
+static int32_t trace_threads = 0;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Which row of the timeline this thread is, numbered from 1 the first time it ends a span
+static __thread int32_t trace_thread = 0;
+
+static inline void trace_open();
+
+static inline void trace_begin(trace_span_t* span, const char* name);
+
+static inline void trace_end(trace_span_t* span, const char* detail);
+
+static inline void trace_add(trace_span_t* span, const char* detail);
+
+static inline double trace_micros(struct timespec* time);
+
+static inline int32_t trace_write(const char* path);
+
+/*
+ * =====================================================================================
+ * Turns tracing on. Times in the trace are from now.
+ * =====================================================================================
+ */
+static inline void trace_open()
+{
+	clock_gettime(CLOCK_MONOTONIC, &trace_start);
+	trace_enabled = TRUE;
+}
+
+/*
+ * =====================================================================================
+ * Starts a span called name. Does nothing if tracing is off.
+ * =====================================================================================
+ */
+static inline void trace_begin(trace_span_t* span, const char* name)
+{
+	if (trace_enabled == TRUE)
+	{
+		span->name = name;
+		clock_gettime(CLOCK_MONOTONIC, &span->start);
+	}
+}
+
+/*
+ * =====================================================================================
+ * Ends a span started by trace_begin, with detail (NULL for none) saying what it was
+ * about. Does nothing if tracing is off.
+ * =====================================================================================
+ */
+static inline void trace_end(trace_span_t* span, const char* detail)
+{
+	if (trace_enabled == TRUE)
+		trace_add(span, detail);
+}
+
+/*
+ * =====================================================================================
+ * Adds a finished span to the trace. A span that can't be added because we ran out
+ * of memory is left out.
+ * =====================================================================================
+ */
+static inline void trace_add(trace_span_t* span, const char* detail)
+{
+	struct timespec now;
+	trace_event_t *event;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&trace_lock);
+	if (trace_thread == 0)
+		trace_thread = ++trace_threads;
+	if (trace_count == trace_capacity)
+	{
+		int32_t capacity = (trace_capacity == 0) ? 1024 : trace_capacity * 2;
+		trace_event_t *events = (trace_event_t*) realloc(trace_events, sizeof(trace_event_t) * capacity);
+		if (events == NULL)
+		{
+			pthread_mutex_unlock(&trace_lock);
+			return;
+		}
+		trace_events = events;
+		trace_capacity = capacity;
+	}
+	event = &trace_events[trace_count++];
+	event->name = span->name;
+	event->detail = (detail == NULL) ? NULL : strdup(detail);
+	event->start = trace_micros(&span->start);
+	event->duration = trace_micros(&now) - event->start;
+	event->thread = trace_thread;
+	pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * =====================================================================================
+ * Returns how many microseconds after trace_open time was.
+ * =====================================================================================
+ */
+static inline double trace_micros(struct timespec* time)
+{
+	return (time->tv_sec - trace_start.tv_sec) * 1e6 + (time->tv_nsec - trace_start.tv_nsec) / 1e3;
+}
+
+/*
+ * =====================================================================================
+ * Writes every span to path as a Chrome trace event file and frees them. Call it once
+ * every thread that adds spans is done. Returns FALSE if the file could not be
+ * written.
+ * =====================================================================================
+ */
+static inline int32_t trace_write(const char* path)
+{
+	FILE *fptr = fopen(path, "w");
+	int32_t ok = (fptr != NULL);
+	int32_t i;
+
+	if (ok == TRUE)
+	{
+		fprintf(fptr, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		for (i = 1; i <= trace_threads; i++)
+		{
+			fprintf(fptr, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}},\n",
+				i, i);
+		}
+		for (i = 0; i < trace_count; i++)
+		{
+			trace_event_t *event = &trace_events[i];
+
+			fprintf(fptr, "{\"name\":\"%s\",\"cat\":\"assembler\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d",
+				event->name, event->start, event->duration, event->thread);
+			if (event->detail != NULL)
+			{
+				fprintf(fptr, ",\"args\":{\"file\":");
+				print_json_string(fptr, event->detail);
+				fprintf(fptr, "}");
+			}
+			fprintf(fptr, "}%s\n", (i == trace_count - 1) ? "" : ",");
+		}
+		fprintf(fptr, "]}\n");
+		if (fclose(fptr) != 0)
+			ok = FALSE;
+	}
+
+	for (i = 0; i < trace_count; i++)
+		free(trace_events[i].detail);
+	free(trace_events);
+	trace_events = NULL;
+	trace_count = trace_capacity = 0;
+	return ok;
+}
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef __UTILITIES_H_
+#define __UTILITIES_H_
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -5,9 +8,41 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <math.h>
+#include <pthread.h>
+
+#include "tokenizer.h"
+#include "initialization.h"
+#include "source.h"
+#include "counters.h"
+#include "trace.h"
 
-#define TEMP_FILE_NAME "kkumar91temp.txt"
 #define MAX_LINE_LENGTH 256
+#define MAX_LEX_THREADS 64
+// Fewest bytes of source worth handing to a lexing thread of their own
+#define MIN_LEX_CHUNK (1 << 20)
+
+// What the zeroth pass needs to know about a line
+#define LINE_HAS_TEXT 1
+#define LINE_HAS_DATA 2
+#define LINE_HAS_NOP 4
+// Set when the line has a first token (see lexed_line_t)
+#define LINE_HAS_TOKEN 8
+
+// Characters needed to write out one word: 32 digits and a newline
+#define WORD_TEXT_LENGTH 33
+
+// Builds the 8 '0'/'1' characters for one byte, most significant bit first
+#define BIN_BYTE(b) { '0' + (((b) >> 7) & 1), '0' + (((b) >> 6) & 1), '0' + (((b) >> 5) & 1), \
+	'0' + (((b) >> 4) & 1), '0' + (((b) >> 3) & 1), '0' + (((b) >> 2) & 1), '0' + (((b) >> 1) & 1), \
+	'0' + ((b) & 1) }
+#define BIN_BYTES_2(b) BIN_BYTE(b), BIN_BYTE((b) + 1)
+#define BIN_BYTES_4(b) BIN_BYTES_2(b), BIN_BYTES_2((b) + 2)
+#define BIN_BYTES_16(b) BIN_BYTES_4(b), BIN_BYTES_4((b) + 4), BIN_BYTES_4((b) + 8), BIN_BYTES_4((b) + 12)
+#define BIN_BYTES_64(b) BIN_BYTES_16(b), BIN_BYTES_16((b) + 16), BIN_BYTES_16((b) + 32), BIN_BYTES_16((b) + 48)
+#define BIN_BYTES_256(b) BIN_BYTES_64(b), BIN_BYTES_64((b) + 64), BIN_BYTES_64((b) + 128), BIN_BYTES_64((b) + 192)
+
+// Binary text for every byte value, so a word is written out with four table lookups
+static const char bin_byte_table[256][8] = { BIN_BYTES_256(0) };
 
 /*
  * =====================================================================================
@@ -15,197 +50,377 @@
  * Filename:  utilities.h
  *
  * Description: Provides several utility methods that the assembler will use when assembling.
- * In this header file, there is an utility to convert from integer to binary, counting 
- * the number of occurances of a character in a given string and a function to reverse a string.
+ * In this header file, there is an utility to write a word out in binary and one for counting
+ * the number of occurances of a character in a given string.
  *
  * It also provides a zeroth pass method that organizes multiple data and text sections into
- * one of each.
+ * one of each. Before that, the source is lexed: it is split into lines (memchr finds
+ * each newline), each line is checked for the section names, and its first token and
+ * the instruction it names are found, which big files can have done by several threads
+ * at once. The first and second pass take the first token of a text line from there
+ * instead of finding it again. The operands are not lexed here; they are tokenized
+ * from the line's text when it is encoded (see encode_text_line).
  *
  * Author:  Karthik Kumar, kkumar91@vt.edu
  *
  * =====================================================================================
  */
 
-char* int32_to_bin(int32_t val, int32_t numOfBits);
+/*
+ * A source line and the LINE_HAS_* flags for it. With LINE_HAS_TOKEN, token is the
+ * first token of the line as a text section line is split (see lex_line), and opcode
+ * the instruction it names, or NULL.
+ */
+typedef struct
+{
+	line_t line;
+	token_view_t token;
+	const opcode_entry_t *opcode;
+	int32_t flags;
+} lexed_line_t;
+
+/*
+ * The lines the zeroth pass puts together for the first and second pass. lines has the
+ * lexed lines of the source and then the ones the zeroth pass adds, and order has the
+ * numbers of the lines the passes read, in the order they read them.
+ */
+typedef struct
+{
+	lexed_line_t *lines;
+	int32_t count;
+	int32_t *order;
+	int32_t length;
+} merged_lines_t;
+
+/*
+ * A line aligned piece of the source and its lexed lines, done by one thread,
+ * and what that thread counted doing it.
+ */
+typedef struct
+{
+	char *start;
+	char *end;
+	delim_set_t *delims;
+	lexed_line_t *lines;
+	int32_t count;
+	int32_t capacity;
+	int32_t ok;
+	run_counters_t counters;
+} lex_chunk_t;
+
+static inline size_t render_word(uint32_t word, char* output);
+
+static inline int count_num_occurances(const char* str, char character);
+
+static inline int32_t zeroth_pass(source_t* src, int32_t threads, delim_set_t* delims, merged_lines_t* merged);
+
+static inline lexed_line_t* next_merged_line(merged_lines_t* merged, int32_t* next);
 
-int count_num_occurances(const char* str, char character);
+static inline void free_merged_lines(merged_lines_t* merged);
 
-void reverse(char* input);
+static inline int32_t lex_source(source_t* src, int32_t threads, delim_set_t* delims, lexed_line_t** lines, int32_t* count);
 
-void zeroth_pass(char* src_file);
+static inline void* lex_worker(void* arg);
+
+static inline void lex_line(line_t* line, delim_set_t* delims, lexed_line_t* lexed);
 
 /*
  * =======================================================================================
  * Zeroth pass. This handles the case for extra credit when we have multiple data and text
  * segments. It goes through and first gathers all the text segments and does the same for 
- * the data sections. We will call the temp file we generate "kkumar91temp.txt" and we delete
- * the file after each use.
+ * the data sections. Nothing is copied: merged gets the lexed lines and the order the
+ * first and second pass should see them in, and the caller frees it with
+ * free_merged_lines. The lines are lexed first (see lex_source) with up to threads
+ * threads, splitting them with delims, and the merge itself only looks at the flags of
+ * each line. Returns FALSE if we ran out of memory.
  *
  * =======================================================================================
  */
-void zeroth_pass(char* src_file)
+static inline int32_t zeroth_pass(source_t* src, int32_t threads, delim_set_t* delims, merged_lines_t* merged)
 {
-	FILE *src_fptr;
-	FILE *dest_fptr;
-	char line[MAX_LINE_LENGTH + 1];
-	char *ret = NULL;
-	int32_t text_part = FALSE;
-	int32_t data_part = FALSE;
-
-	// Open the file for reading.
-	src_fptr = fopen(src_file, "r");
-	if (src_fptr == NULL)
-	{
-		// Check to see if we were able to open the file successfully.
-		printf("ERROR: Unable to open file %s. Aborting...\n", src_file);
-		exit(-1);
-	}
-	// Open the file for writing.
-	dest_fptr = fopen(TEMP_FILE_NAME, "w");
-	if (dest_fptr == NULL)
+	// The lines the merge adds, after the ones from the source
+	static char text_line[] = ".text\n", nop_line[] = "nop\n", data_line[] = ".data\n";
+	lexed_line_t *lines;
+	line_t added;
+	int32_t count;
+	int32_t i;
+
+	memset(merged, 0, sizeof(merged_lines_t));
+	if (lex_source(src, threads, delims, &lines, &count) == FALSE)
+		return FALSE;
+
+	merged->lines = (lexed_line_t*) counted_realloc(lines, sizeof(lexed_line_t) * (count + 3));
+	merged->order = (int32_t*) counted_malloc(sizeof(int32_t) * (count + 3));
+	if (merged->lines == NULL || merged->order == NULL)
 	{
-		// Check to see if we were able to open the file successfully.
-		printf("ERROR: Unable to open file %s. Aborting...\n", TEMP_FILE_NAME);
-		exit(-1);
+		if (merged->lines == NULL)
+			free(lines);
+		free_merged_lines(merged);
+		return FALSE;
 	}
+	lines = merged->lines;
+	merged->count = count + 3;
+
+	added.start = text_line;
+	added.len = strlen(text_line);
+	lex_line(&added, delims, &lines[count]);
+	added.start = nop_line;
+	added.len = strlen(nop_line);
+	lex_line(&added, delims, &lines[count + 1]);
+	added.start = data_line;
+	added.len = strlen(data_line);
+	lex_line(&added, delims, &lines[count + 2]);
 
 	// We do .text segment first
-	fputs(".text\n", dest_fptr);
-	while ((ret = fgets(line, MAX_LINE_LENGTH, src_fptr)) != NULL)
+	merged->order[merged->length++] = count;
+	for (i = 0; i < count; i++)
 	{
-		text_part = TRUE;
-		data_part = FALSE;
 		// If we find a .data in the middle, loop until we find another .text
-		if (strstr(line, ".data") != NULL)
+		if (lines[i].flags & LINE_HAS_DATA)
 		{
-			while ((ret = fgets(line, MAX_LINE_LENGTH, src_fptr)))
+			for (i++; i < count; i++)
 			{
-				text_part = FALSE;
-				data_part = TRUE;
-				if (strstr(line, ".text"))
-				{
-					text_part = TRUE;
+				if (lines[i].flags & LINE_HAS_TEXT)
 					break;
-				}
 			}
-			text_part = TRUE;
 		}
-		else if (text_part == TRUE)
+		else
 		{
 			// Write the instruction w/o the nop, we will do that later
-			if (strstr(line, "nop") == NULL && strstr(line, ".text") == NULL)
-				fputs(line, dest_fptr);
-			
-		}		
+			if ((lines[i].flags & (LINE_HAS_NOP | LINE_HAS_TEXT)) == 0)
+				merged->order[merged->length++] = i;
+		}
 	}
 
-	fputs("nop\n.data\n", dest_fptr);
+	merged->order[merged->length++] = count + 1;
+	merged->order[merged->length++] = count + 2;
 
 	// Start over
-	fclose(src_fptr);
-	src_fptr = fopen(src_file, "r");
-
-	if (src_fptr == NULL)
-	{
-		// Check to see if we were able to open the file successfully.
-		printf("ERROR: Unable to open file %s. Aborting...\n", src_file);
-		exit(-1);
-	}
-	while ((ret = fgets(line, MAX_LINE_LENGTH, src_fptr)) != NULL)
+	for (i = 0; i < count; i++)
 	{
-		text_part = FALSE;
-		data_part = TRUE;
 		// If we find a .text within the .data section, look through until we reach data again.
-		if (strstr(line, ".text") != NULL)
+		if (lines[i].flags & LINE_HAS_TEXT)
 		{
-			while ((ret = fgets(line, MAX_LINE_LENGTH, src_fptr)) != NULL)
+			for (i++; i < count; i++)
 			{
-				text_part = TRUE;
-				data_part = FALSE;
-				if (strstr(line, ".data"))
-				{
-					data_part = TRUE;
+				if (lines[i].flags & LINE_HAS_DATA)
 					break;
-				}
 			}
-				
-			data_part = TRUE;
 		}
-		else if (data_part == TRUE )
+		else
 		{
-			fputs(line, dest_fptr);	
-		}		
+			merged->order[merged->length++] = i;
+		}
 	}
-	fclose(src_fptr);
-	fclose(dest_fptr);
+	return TRUE;
 }
 
 /*
- * ============================================================================
- *
- * Converts a given integer value using the given numOfBits. Method: Loop until 
- * the value given is not 0, shift left by one each iteration. And it with a mask
- * of 1 and add a one to our output. Reverse the string at the end.
- *
- * ============================================================================
+ * =======================================================================================
+ * Gets line number *next of the merged lines and moves on to the next one. Returns NULL
+ * when they are done.
+ * =======================================================================================
  */
-char* int32_to_bin(int32_t val, int32_t numOfBits)
+static inline lexed_line_t* next_merged_line(merged_lines_t* merged, int32_t* next)
 {
-	char* output = (char*)(malloc(numOfBits + 1));
-	int mask = 1;
-	int count = 0;
-	int32_t num = val;
-	int neg_flag = FALSE;
-	if (num < 0)
-		neg_flag = TRUE;
-	while (num != 0)
+	if (*next >= merged->length)
+		return NULL;
+	return &merged->lines[merged->order[(*next)++]];
+}
+
+/*
+ * =======================================================================================
+ * Frees the merged lines. The lines themselves belong to the source.
+ * =======================================================================================
+ */
+static inline void free_merged_lines(merged_lines_t* merged)
+{
+	free(merged->lines);
+	free(merged->order);
+	memset(merged, 0, sizeof(merged_lines_t));
+}
+
+/*
+ * =======================================================================================
+ * Splits the source into lines, flags the ones that mention .text, .data or nop and finds
+ * their first tokens (see lex_line) with delims. The source is cut into up to threads line aligned chunks of at least MIN_LEX_CHUNK bytes,
+ * each found with memchr from a rough split point, and every chunk is lexed by its own
+ * thread. The chunks are then put back together in order, so lines ends up the same as
+ * lexing the whole source front to back. The caller frees lines. Returns FALSE if we ran
+ * out of memory.
+ * =======================================================================================
+ */
+static inline int32_t lex_source(source_t* src, int32_t threads, delim_set_t* delims, lexed_line_t** lines, int32_t* count)
+{
+	lex_chunk_t chunks[MAX_LEX_THREADS];
+	pthread_t thread_ids[MAX_LEX_THREADS];
+	int32_t started[MAX_LEX_THREADS];
+	int32_t num_chunks = threads;
+	int32_t ok = TRUE;
+	int32_t total = 0;
+	int32_t i;
+
+	if ((size_t) num_chunks > src->len / MIN_LEX_CHUNK)
+		num_chunks = (int32_t)(src->len / MIN_LEX_CHUNK);
+	if (num_chunks > MAX_LEX_THREADS)
+		num_chunks = MAX_LEX_THREADS;
+	if (num_chunks < 1)
+		num_chunks = 1;
+
+	memset(chunks, 0, sizeof(chunks));
+	for (i = 0; i < num_chunks; i++)
 	{
-		if (num == -1 && neg_flag == TRUE)
-			break;
-		int temp = num & mask;
-		if (temp == 0)
+		char *split;
+
+		chunks[i].delims = delims;
+		// Every chunk but the first starts right after the first newline past its split point
+		chunks[i].start = (i == 0) ? src->data : chunks[i - 1].end;
+		if (i == num_chunks - 1)
+			chunks[i].end = src->data + src->len;
+		else
 		{
-			strcat(output, "0"); 
-			num = num >> 1;
-			count++;
+			split = src->data + src->len / num_chunks * (i + 1);
+			if (split < chunks[i].start)
+				split = chunks[i].start;
+			split = (char*) memchr(split, '\n', src->data + src->len - split);
+			chunks[i].end = (split == NULL) ? src->data + src->len : split + 1;
 		}
-		else
+
+		// The first chunk is done in this thread, and so is any chunk we can't start a thread for
+		started[i] = (i > 0 && pthread_create(&thread_ids[i], NULL, lex_worker, &chunks[i]) == 0);
+	}
+	for (i = 0; i < num_chunks; i++)
+	{
+		if (started[i] == FALSE)
+			lex_worker(&chunks[i]);
+	}
+	for (i = 0; i < num_chunks; i++)
+	{
+		if (started[i] == TRUE)
 		{
-			strcat(output, "1");
-			num = num >> 1;
-			count++;
+			pthread_join(thread_ids[i], NULL);
+			add_counters(&chunks[i].counters);
 		}
+		ok &= chunks[i].ok;
+		total += chunks[i].count;
+	}
+
+	if (num_chunks == 1 && ok == TRUE)
+	{
+		// Nothing to put together
+		*lines = chunks[0].lines;
+		*count = chunks[0].count;
+		return TRUE;
 	}
-	while (count < numOfBits)
+
+	*lines = NULL;
+	*count = 0;
+	if (ok == TRUE)
+		*lines = (lexed_line_t*) counted_malloc(sizeof(lexed_line_t) * (total + 1));
+	if (*lines != NULL)
 	{
-		// Sign extension
-		if (neg_flag == TRUE)
+		for (i = 0; i < num_chunks; i++)
 		{
-			strcat(output, "1");
-			count++;
+			memcpy(*lines + *count, chunks[i].lines, sizeof(lexed_line_t) * chunks[i].count);
+			*count += chunks[i].count;
 		}
-		else
+	}
+	for (i = 0; i < num_chunks; i++)
+		free(chunks[i].lines);
+	return (*lines != NULL);
+}
+
+/*
+ * =======================================================================================
+ * A lexing thread. Finds the lines of one chunk and lexes them.
+ * =======================================================================================
+ */
+static inline void* lex_worker(void* arg)
+{
+	lex_chunk_t *chunk = (lex_chunk_t*) arg;
+	char *cursor = chunk->start;
+	run_counters_t saved;
+	trace_span_t span;
+	line_t line;
+
+	trace_begin(&span, "lex_chunk");
+	begin_counting(&saved);
+	chunk->ok = TRUE;
+	while (next_line(&cursor, chunk->end, &line) == TRUE)
+	{
+		if (chunk->count == chunk->capacity)
 		{
-			strcat(output, "0");
-			count++;
+			int32_t capacity = (chunk->capacity == 0) ? 1024 : chunk->capacity * 2;
+			lexed_line_t *lines = (lexed_line_t*) counted_realloc(chunk->lines, sizeof(lexed_line_t) * capacity);
+			if (lines == NULL)
+			{
+				chunk->ok = FALSE;
+				break;
+			}
+			chunk->lines = lines;
+			chunk->capacity = capacity;
 		}
+		lex_line(&line, chunk->delims, &chunk->lines[chunk->count++]);
+	}
+	end_counting(&saved, &chunk->counters);
+	trace_end(&span, NULL);
+	return NULL;
+}
+
+/*
+ * =======================================================================================
+ * Lexes one line into lexed: its flags, and its first token split with delims (the ones
+ * the passes use for text section lines) and the instruction that names. A line whose
+ * first token starts a comment counts as having none.
+ * =======================================================================================
+ */
+static inline void lex_line(line_t* line, delim_set_t* delims, lexed_line_t* lexed)
+{
+	char *tok_ptr;
+
+	lexed->line = *line;
+	lexed->opcode = NULL;
+	lexed->flags = (line_contains(line, ".text") ? LINE_HAS_TEXT : 0) |
+		(line_contains(line, ".data") ? LINE_HAS_DATA : 0) | (line_contains(line, "nop") ? LINE_HAS_NOP : 0);
+	if (parse_token_view(line->start, line->start + line->len, delims, &tok_ptr, NULL, &lexed->token) &&
+		*lexed->token.start != '#')
+	{
+		lexed->flags |= LINE_HAS_TOKEN;
+		lexed->opcode = find_opcode(lexed->token.start, lexed->token.len);
 	}
-	output[strlen(output)] = '\0';
-	reverse(output);
-	return output;
+}
+
+/*
+ * ============================================================================
+ * Writes a word out as 32 '0'/'1' characters, most significant bit first,
+ * followed by a newline. Each byte is copied from bin_byte_table. output needs
+ * room for WORD_TEXT_LENGTH characters and is not null terminated. Returns the
+ * number of characters written.
+ * ============================================================================
+ */
+static inline size_t render_word(uint32_t word, char* output)
+{
+	memcpy(output, bin_byte_table[(word >> 24) & 0xff], 8);
+	memcpy(output + 8, bin_byte_table[(word >> 16) & 0xff], 8);
+	memcpy(output + 16, bin_byte_table[(word >> 8) & 0xff], 8);
+	memcpy(output + 24, bin_byte_table[word & 0xff], 8);
+	output[32] = '\n';
+	return WORD_TEXT_LENGTH;
 }
 
 /*
  * =========================================================================
  * Counts the number of occcurances of a specifc character in a given string.
- * Simply loops through and finds all the characters that match the given one.
+ * Simply loops through and finds all the characters that match the given one,
+ * stopping at the end of the line, a comment or the end of the string (a
+ * copied line has no newline if it was the last one or was cut short).
  * =========================================================================
  */
-int count_num_occurances(const char* str, char character)
+static inline int count_num_occurances(const char* str, char character)
 {
 	int count = 0;
 	const char* i = str;
-	while (1)
+	while (*i != '\0')
 	{
 		if (*i == character)
 			count++;
@@ -216,23 +431,4 @@ int count_num_occurances(const char* str, char character)
 	return count;
 }
 
-/*
- * =========================================================================
- * Reverses a given string. 
- * =========================================================================
- */
-void reverse(char* str)
-{
-	int start, end;
-	char temp;
-	start = temp = 0;
-	end = strlen(str) - 1;
-	
-	while (start < end)
-	{
-		// Swap start and end
-		temp = str[start];
-		str[start++] = str[end];
-		str[end--] = temp;
-	}
- }
+#endif